@@ -10,154 +10,396 @@
 
 #include "models/Errors.hpp"
 #include "models/Objects.hpp"
+#include "models/Trace.hpp"
+#include "models/ZataValue.hpp"
+#include "builtins/builtins_type.hpp"
 #include "utils/SLL_loader.hpp"
 #include "vm_deps/VmModels.hpp"
+#include "vm_deps/Dispatch.hpp"
+#include "vm_deps/Linker.hpp"
+#include "vm_deps/OperandStack.hpp"
+#include "vm_deps/Quicken.hpp"
 
 #include "vm_deps/ZvmOpcodes.hpp"
 
+// 线索化模式下指令位置保存在局部变量ip中(便于编译器放进寄存器)
+// this->pc只在需要时同步: 压帧/重入exec之前用ZVM_SYNC_PC, 切换代码对象后由ZVM_LOAD_CODE从this->pc恢复ip
+#if ZVM_COMPUTED_GOTO
+#define ZVM_TARGET(op) op_##op
+#define ZVM_DEFAULT op_UNKNOWN
+#define ZVM_DISPATCH() goto *static_cast<const void*>(dispatch_base + (ip++)->handler)
+#define ZVM_ARG(i) ip[(i)].operand
+#define ZVM_SKIP(n) (ip += (n))
+#define ZVM_SYNC_PC() (this->pc = static_cast<int>(ip - stream))
+#define ZVM_LOAD_CODE(code_obj) \
+    (stream = build_threaded_code(*(code_obj), dispatch_table, &&op_UNKNOWN, &&op_END).data(), \
+     ip = stream + this->pc)
+#define ZVM_SITE() static_cast<size_t>(ip - stream - 1)
+#define ZVM_REWRITE(site, op) (stream[(site)].handler = dispatch_offset(dispatch_table[(op)], &&op_UNKNOWN))
+#else
+#define ZVM_TARGET(op) case Opcode::op
+#define ZVM_DEFAULT default
+#define ZVM_DISPATCH() continue
+#define ZVM_ARG(i) stream[this->pc + (i)].operand
+#define ZVM_SKIP(n) (this->pc += (n))
+#define ZVM_SYNC_PC() ((void)0)
+#define ZVM_LOAD_CODE(code_obj) (stream = build_threaded_code(*(code_obj), nullptr, nullptr, nullptr).data())
+#define ZVM_SITE() static_cast<size_t>(this->pc - 1)
+#define ZVM_REWRITE(site, op) (stream[(site)].operand = (op))
+#endif
+
+// 特化二元指令的公共部分: 守卫两个操作数都满足guard, 结果直接写回次栈顶
+// 守卫失败时不消耗任何操作数, 跳到b_calc_deopt退回通用B_CALC
+#define ZVM_QUICK_BINARY(guard, expr) \
+    { \
+        const ZataValue& y = this->op_stack.peek(0); \
+        ZataValue& x = this->op_stack.peek(1); \
+        if (!(x.guard() && y.guard())) { \
+            goto b_calc_deopt; \
+        } \
+        x = (expr); \
+        this->op_stack.pop(); \
+        ZVM_SKIP(1); \
+        ZVM_DISPATCH(); \
+    }
+
 // 虚拟机
-class ZataVirtualMachine {
+// 构造时登记为回收器的根来源, 析构时注销
+// 执行的代码都先经过校验(vm_deps/Verifier.hpp), 分发循环因此不检查常量/局部/全局下标, pattern范围和操作数栈下溢
+class ZataVirtualMachine final : public ZataRootSource {
 private:
-    std::stack<ZataObjectPtr>    op_stack;
+    ZataOperandStack             op_stack;
     std::stack<CallFrame>        call_stack;
     std::stack<Block>            block_stack;
 
-    std::vector<ZataObjectPtr>   locals;
-    std::vector<ZataObjectPtr>   globals;
-    std::vector<ZataObjectPtr>   constant_pool;
+    std::vector<ZataValue>       value_stack;  // 所有帧的局部变量窗口, 连续存放
+    std::vector<ZataValue>       globals;
 
-    std::shared_ptr<ZataModule>  module;
+    ZataModule*                  module = nullptr;
     std::vector<Context>         contexts;
-    std::vector<int>             co_code;
+    ZataHeap&                    heap = ZataHeap::instance();
     int pc = 0;
     bool running = false;
 
+    // 当前帧的缓存, 只在进入/离开帧时更新
+    ZataCodeObject*              code = nullptr;
+    ZataValue*                   locals = nullptr;
+    const ZataValue*             constant_pool = nullptr;
+
+    // 常量池和局部变量初值在第一次执行时拆箱成ZataValue, 之后直接复用
+    static void prepare_values(ZataCodeObject& code_object) {
+        if (code_object.values_ready) {
+            return;
+        }
+        code_object.const_values.clear();
+        code_object.const_values.reserve(code_object.const_count());
+        for (size_t i = 0; i < code_object.const_count(); ++i) {
+            code_object.const_values.push_back(unbox_object(code_object.constant(i)));
+        }
+        code_object.local_values.clear();
+        code_object.local_values.reserve(code_object.locals.size());
+        for (const auto& obj : code_object.locals) {
+            code_object.local_values.push_back(unbox_object(obj));
+        }
+        code_object.values_ready = true;
+    }
+
+    // 在value_stack顶部为code_object开一个局部变量窗口并压入新帧
+    // 前arg_count个槽位由调用方填入参数, 其余按code_object->locals初始化
+    void push_frame(ZataCodeObject* code_object, ZataObjectPtr owner,
+                    const std::string_view name, const int arg_count) {
+        prepare_values(*code_object);
+        const size_t base = this->value_stack.size();
+        const size_t local_count = std::max(code_object->local_values.size(), static_cast<size_t>(arg_count));
+        this->value_stack.resize(base + local_count);
+        for (size_t i = arg_count; i < code_object->local_values.size(); ++i) {
+            this->value_stack[base + i] = code_object->local_values[i];
+        }
+
+        this->call_stack.push(CallFrame{
+            .return_address = this->pc,
+            .locals_base = base,
+            .name = name,
+            .code_object = code_object,
+            .owner = std::move(owner),
+        });
+    }
+
+    // 当前代码对象中site处的属性内联缓存, 第一次用到时分配
+    ZataAttrCache& attr_cache(const size_t site) {
+        auto& caches = this->code->attr_caches;
+        if (caches.size() <= site) {
+            caches.resize(this->code->exec_code().slots());
+        }
+        auto& cache = caches[site];
+        if (!cache) {
+            cache = std::make_unique<ZataAttrCache>();
+        }
+        return *cache;
+    }
+
+    // B_CALC的慢路径: 装箱后按pattern直接取内置类型的二元槽位
+    ZataValue binary_object(const int pattern, ZataValue a, ZataValue b) {
+        ZataObjectPtr b_obj = box_value(std::move(b));
+        ZataObjectPtr a_obj = box_value(std::move(a));
+        auto* b_ptr = zata_cast<ZataBuiltinsClass>(b_obj);
+        auto* a_ptr = zata_cast<ZataBuiltinsClass>(a_obj);
+        if (!a_ptr || !b_ptr) {
+            zata_vm_error_thrower(this->call_stack ,ZataError{
+                .name = "ZataRunTimeError",
+                .message = "B_CALC opcode: can not use on the type which is not a builtins type",
+                .error_code = 0
+            });
+        }
+
+        const auto* type = a_ptr->object_type();
+        const auto slot = type ? type->binary_slots[pattern] : nullptr;
+        ZataObjectPtr result = slot ? slot(a_ptr, b_ptr) : nullptr;
+        if (nullptr == result) {
+            zata_vm_error_thrower(this->call_stack ,ZataError{
+                .name = "ZataTypeError",
+                .message = "<object id="+std::to_string(a_ptr->object_id())+">can not support op "+std::to_string(pattern),
+                .error_code = 0
+            });
+        }
+        return unbox_object(std::move(result));
+    }
+
+    // 二元运算: 先走立即数快速路径, 不行再走对象路径
+    ZataValue binary(const int pattern, const ZataValue& a, const ZataValue& b) {
+        ZataValue value;
+        if (value_binary(pattern, a, b, value)) {
+            return value;
+        }
+        return this->binary_object(pattern, a, b);
+    }
+
+    // GET_ATTR: 实例字段经site处的内联缓存查找, 类则取类属性
+    ZataValue get_attr(const ZataValue& obj, const int field_addr, const size_t site) {
+        auto* instance_ptr = zata_cast<ZataInstance>(obj.as_object());
+        if (instance_ptr) {
+            ZataAttrCache& cache = this->attr_cache(site);
+            const bool cacheable = instance_ptr->cacheable();
+            int slot;
+            if (const auto* entry = cacheable ? cache.find(instance_ptr->shape.get()) : nullptr) {
+                slot = entry->slot;
+            } else {
+                slot = instance_ptr->find_field(instance_ptr->field_names().at(field_addr));
+                if (cacheable) {
+                    cache.insert(instance_ptr->shape, slot);
+                }
+            }
+            // 没有这个字段时得到空值
+            return slot >= 0 ? instance_ptr->slots[slot] : ZataValue();
+        }
+
+        // 再尝试转换为ZataClass
+        auto* class_ptr = zata_cast<ZataClass>(obj.as_object());
+        if (class_ptr) {
+            auto name = class_ptr->names.at(field_addr);
+            return unbox_object(class_ptr->attrs[name]);
+        }
+
+        zata_vm_error_thrower(this->call_stack ,ZataError{
+                .name = "ZataRunTimeError",
+                .message = "GET_ATTR: object is not ZataInstance or ZataClass",
+                .error_code = 0
+            });
+        return {};
+    }
+
+    // 把当前帧的代码/局部变量/常量池读入缓存
+    void load_frame() {
+        const CallFrame& frame = this->call_stack.top();
+        this->code = frame.code_object;
+        this->locals = this->value_stack.data() + frame.locals_base;
+        this->constant_pool = frame.code_object->const_values.data();
+    }
+
 public:
     ZataVirtualMachine(
-        const std::shared_ptr<ZataModule>& _module,
+        ZataModule* _module,
         const std::vector<Context>& _contexts)
     {
         this->module = _module;
         this->globals.resize(_module->global_count);
         this->contexts = _contexts;
+        link_module(*this->module);
+        this->heap.add_root_source(this);
     }
 
-    std::stack<ZataObjectPtr> run() {
-        CallFrame frame{
-            .pc = this->pc,
-            .locals = this->locals,
-            .return_address = this->pc,
-            .name = module->object_name,
-        };
-        this->call_stack.push(frame);
-        this->exec(this->module->code);
-        return this->op_stack;
+    ~ZataVirtualMachine() {
+        this->heap.remove_root_source(this);
     }
 
-    std::stack<ZataObjectPtr> exec(const std::shared_ptr<ZataCodeObject>& code_object) {
-        this->running = true;
-        this->locals = code_object->locals;
-        this->constant_pool = code_object->consts;
-        this->co_code = code_object->co_code;
+    ZataVirtualMachine(const ZataVirtualMachine&) = delete;
+    ZataVirtualMachine& operator=(const ZataVirtualMachine&) = delete;
 
-        while(this->running) {
+    // 回收器的根: 操作数栈, 全局变量, 各帧的局部变量窗口和函数/代码对象, 模块(经由它到达各级常量池)
+    void trace_roots(ZataHeap& gc_heap) override {
+        for (const auto& value : this->op_stack) {
+            gc_heap.mark(value);
+        }
+        for (const auto& value : this->value_stack) {
+            gc_heap.mark(value);
+        }
+        for (const auto& value : this->globals) {
+            gc_heap.mark(value);
+        }
+        for (const auto& frame : call_frames(this->call_stack)) {
+            gc_heap.mark(frame.owner);
+            gc_heap.mark(frame.code_object);
+        }
+        gc_heap.mark(this->module);
+    }
 
-            if (this->pc >= co_code.size()){
-                this->running = false;
-                break;
-            }
+    // 执行模块, 返回操作数栈上剩下的值(栈底在前), 结果是移动出来的
+    std::vector<ZataValue> run() {
+        this->heap.safe_point();
+        this->value_stack.reserve(1024);
+        this->exec(this->module->code, this->module->object_name);
+        return this->op_stack.release();
+    }
 
-            const int opcode = co_code[this->pc];
+    // 在新帧中执行code_object, 直到该帧RET返回或遇到HALT
+    // 可重入: MAKE_INSTANCE等需要在指令内部执行字节码时也通过它进入
+    // code_object必须已经按本虚拟机的全局变量个数经过prepare_code(模块代码在构造时链接)
+    void exec(ZataCodeObject* code_object, const std::string_view name) {
+        this->running = true;
+        const size_t entry_depth = this->call_stack.size();
+        this->op_stack.reserve(code_max_stack(*code_object));
+        this->push_frame(code_object, code_object, name, 0);
+        this->pc = 0;
+        this->load_frame();
+
+#if ZVM_COMPUTED_GOTO
+        // 处理程序表: 下标为opcode, 未实现的指令统一跳到op_UNKNOWN
+        const void* dispatch_table[256];
+        std::fill(std::begin(dispatch_table), std::end(dispatch_table), &&op_UNKNOWN);
+        dispatch_table[Opcode::U_CALC] = &&op_U_CALC;
+        dispatch_table[Opcode::B_CALC] = &&op_B_CALC;
+        dispatch_table[Opcode::SWAP] = &&op_SWAP;
+        dispatch_table[Opcode::LOAD_CONST] = &&op_LOAD_CONST;
+        dispatch_table[Opcode::LOAD_LOCAL] = &&op_LOAD_LOCAL;
+        dispatch_table[Opcode::STORE_LOCAL] = &&op_STORE_LOCAL;
+        dispatch_table[Opcode::LOAD_GLOBAL] = &&op_LOAD_GLOBAL;
+        dispatch_table[Opcode::STORE_GLOBAL] = &&op_STORE_GLOBAL;
+        dispatch_table[Opcode::JMP] = &&op_JMP;
+        dispatch_table[Opcode::JMP_IF_FALSE] = &&op_JMP_IF_FALSE;
+        dispatch_table[Opcode::JMP_IF_TRUE] = &&op_JMP_IF_TRUE;
+        dispatch_table[Opcode::NOP] = &&op_NOP;
+        dispatch_table[Opcode::CALL] = &&op_CALL;
+        dispatch_table[Opcode::RET] = &&op_RET;
+        dispatch_table[Opcode::MAKE_INSTANCE] = &&op_MAKE_INSTANCE;
+        dispatch_table[Opcode::SET_ATTR] = &&op_SET_ATTR;
+        dispatch_table[Opcode::GET_ATTR] = &&op_GET_ATTR;
+        dispatch_table[Opcode::POP] = &&op_POP;
+        dispatch_table[Opcode::DUP] = &&op_DUP;
+        dispatch_table[Opcode::LOAD_SLL] = &&op_LOAD_SLL;
+        dispatch_table[Opcode::HALT] = &&op_HALT;
+        dispatch_table[Opcode::LOAD_LOCAL2] = &&op_LOAD_LOCAL2;
+        dispatch_table[Opcode::B_CALC_LOCAL_CONST] = &&op_B_CALC_LOCAL_CONST;
+        dispatch_table[Opcode::B_CALC_JMP_IF_FALSE] = &&op_B_CALC_JMP_IF_FALSE;
+        dispatch_table[Opcode::GET_LOCAL_ATTR] = &&op_GET_LOCAL_ATTR;
+        dispatch_table[Opcode::B_ADD_INT] = &&op_B_ADD_INT;
+        dispatch_table[Opcode::B_SUB_INT] = &&op_B_SUB_INT;
+        dispatch_table[Opcode::B_MUL_INT] = &&op_B_MUL_INT;
+        dispatch_table[Opcode::B_EQ_INT] = &&op_B_EQ_INT;
+        dispatch_table[Opcode::B_LT_INT] = &&op_B_LT_INT;
+        dispatch_table[Opcode::B_GT_INT] = &&op_B_GT_INT;
+        dispatch_table[Opcode::B_ADD_FLOAT] = &&op_B_ADD_FLOAT;
+        dispatch_table[Opcode::B_SUB_FLOAT] = &&op_B_SUB_FLOAT;
+        dispatch_table[Opcode::B_EQ_FLOAT] = &&op_B_EQ_FLOAT;
+        dispatch_table[Opcode::B_LT_FLOAT] = &&op_B_LT_FLOAT;
+        dispatch_table[Opcode::B_GT_FLOAT] = &&op_B_GT_FLOAT;
+        dispatch_table[Opcode::B_ADD_FLOAT64] = &&op_B_ADD_FLOAT64;
+        dispatch_table[Opcode::B_LT_FLOAT64] = &&op_B_LT_FLOAT64;
+        dispatch_table[Opcode::B_GT_FLOAT64] = &&op_B_GT_FLOAT64;
+
+        // 单元里的处理程序是相对于op_UNKNOWN的偏移
+        const char* const dispatch_base = static_cast<const char*>(&&op_UNKNOWN);
+        ZataThreadedCell* stream = nullptr;
+        ZataThreadedCell* ip = nullptr;
+        ZVM_LOAD_CODE(this->code);
+        ZVM_DISPATCH();
+        {
+#else
+        // 执行到末尾时落在哨兵单元(HALT)上
+        ZataThreadedCell* stream = nullptr;
+        ZVM_LOAD_CODE(this->code);
+        while(this->running) {
+            const int opcode = stream[this->pc].operand;
             this->pc += 1;
 
             switch (opcode) {
-            case Opcode::B_CALC: {
-                int pattern = co_code[this->pc];
-                this->pc += 1;
-                auto b = this->op_stack.top();
-                this->op_stack.pop();
-                auto a = this->op_stack.top();
-                this->op_stack.pop();
-
-                auto b_ptr = std::dynamic_pointer_cast<ZataBuiltinsClass>(b);
-                auto a_ptr = std::dynamic_pointer_cast<ZataBuiltinsClass>(a);
-                if (!a_ptr || !b_ptr) {
-                    zata_vm_error_thrower(this->call_stack ,ZataError{
-                        .name = "ZataRunTimeError",
-                        .message = "B_CALC opcode: can not use on the type which is not a builtins type",
-                        .error_code = 0
-                    });
-                }
-
-                switch (pattern) {
-                    case 0:  // add（加法）
-                        this->op_stack.emplace(a_ptr->object_type->type_add({a_ptr, b_ptr}));
-                        break;
-                    case 1:  // sub（减法）
-                        this->op_stack.emplace(a_ptr->object_type->type_sub({a_ptr, b_ptr}));
-                        break;
-                    case 2:  // mul（乘法）
-                        this->op_stack.emplace(a_ptr->object_type->type_mul({a_ptr, b_ptr}));
-                        break;
-                    case 3:  // div（除法）
-                        this->op_stack.emplace(a_ptr->object_type->type_div({a_ptr, b_ptr}));
-                        break;
-                    case 4:  // mod（取模）
-                        this->op_stack.emplace(a_ptr->object_type->type_mod({a_ptr, b_ptr}));
-                        break;
-                    case 5:  // eq（等于）
-                        this->op_stack.emplace(a_ptr->object_type->type_eq({a_ptr, b_ptr}));
-                        break;
-                    case 6:  // weq（弱等于）
-                        this->op_stack.emplace(a_ptr->object_type->type_weq({a_ptr, b_ptr}));
-                        break;
-                    case 7:  // lt（小于）
-                        this->op_stack.emplace(a_ptr->object_type->type_lt({a_ptr, b_ptr}));
-                        break;
-                    case 8:  // gt（大于）
-                        this->op_stack.emplace(a_ptr->object_type->type_gt({a_ptr, b_ptr}));
-                        break;
-                    case 9:  // le（小于等于）
-                        this->op_stack.emplace(a_ptr->object_type->type_le({a_ptr, b_ptr}));
-                        break;
-                    case 10: // ge（大于等于）
-                        this->op_stack.emplace(a_ptr->object_type->type_ge({a_ptr, b_ptr}));
-                        break;
-                    case 11: // bit_and（按位与）
-                        this->op_stack.emplace(a_ptr->object_type->type_bit_and({a_ptr, b_ptr}));
-                        break;
-                    case 12: // bit_or（按位或）
-                        this->op_stack.emplace(a_ptr->object_type->type_bit_or({a_ptr, b_ptr}));
-                        break;
-                    case 13: // bit_xor（按位异或）
-                        this->op_stack.emplace(a_ptr->object_type->type_bit_xor({a_ptr, b_ptr}));
-                        break;
-                    default: {
-                        zata_vm_error_thrower(this->call_stack ,ZataError{
-                        .name = "ZataRunTimeError",
-                        .message = "Unknown binary pattern opcode",
-                        .error_code = 0
-                    });
+#endif
+            ZVM_TARGET(B_CALC):
+            b_calc_generic: {
+                int pattern = ZVM_ARG(0);
+                const size_t site = ZVM_SITE();
+                ZVM_SKIP(1);
+                ZataValue b = this->op_stack.take();
+                ZataValue a = this->op_stack.take();
+
+                // 立即数快速路径: 不分配对象, 也不经过魔术方法
+                ZataValue value;
+                if (value_binary(pattern, a, b, value)) {
+                    // 类型稳定的站点改写为特化指令
+                    if (quicken_tick(this->code->quick_counters[site])) {
+                        if (const int quick = quicken_binary(pattern, a, b)) {
+                            ZVM_REWRITE(site, quick);
+                        }
                     }
+                    this->op_stack.push(std::move(value));
+                    ZVM_DISPATCH();
                 }
 
-                if (nullptr == this->op_stack.top()) {
-                    zata_vm_error_thrower(this->call_stack ,ZataError{
-                        .name = "ZataTypeError",
-                        .message = "<object id="+std::to_string(a_ptr->object_id)+">can not support op "+std::to_string(pattern),
-                        .error_code = 0
-                    });
-                }
-                break;
+                this->op_stack.push(this->binary_object(pattern, std::move(a), std::move(b)));
+                ZVM_DISPATCH();
             }
-            case Opcode::U_CALC: {
-                int pattern = co_code[this->pc];
-                this->pc += 1;
-                auto a = this->op_stack.top();
-                this->op_stack.pop();
-
-
-                auto a_ptr = std::dynamic_pointer_cast<ZataBuiltinsClass>(a);
+            // 特化指令的守卫失败: 站点改写回B_CALC并退避, 然后按通用路径执行这一次
+            b_calc_deopt: {
+                const size_t site = ZVM_SITE();
+                ZVM_REWRITE(site, Opcode::B_CALC);
+                quicken_backoff(this->code->quick_counters[site]);
+                goto b_calc_generic;
+            }
+            ZVM_TARGET(B_ADD_INT):
+                ZVM_QUICK_BINARY(is_int, ZataValue::from_int(static_cast<int32_t>(
+                    static_cast<uint32_t>(x.as_int()) + static_cast<uint32_t>(y.as_int()))))
+            ZVM_TARGET(B_SUB_INT):
+                ZVM_QUICK_BINARY(is_int, ZataValue::from_int(static_cast<int32_t>(
+                    static_cast<uint32_t>(x.as_int()) - static_cast<uint32_t>(y.as_int()))))
+            ZVM_TARGET(B_MUL_INT):
+                ZVM_QUICK_BINARY(is_int, ZataValue::from_int(static_cast<int32_t>(
+                    static_cast<uint32_t>(x.as_int()) * static_cast<uint32_t>(y.as_int()))))
+            ZVM_TARGET(B_EQ_INT):
+                ZVM_QUICK_BINARY(is_int, ZataValue::from_bool(x.as_int() == y.as_int()))
+            ZVM_TARGET(B_LT_INT):
+                ZVM_QUICK_BINARY(is_int, ZataValue::from_bool(x.as_int() < y.as_int()))
+            ZVM_TARGET(B_GT_INT):
+                ZVM_QUICK_BINARY(is_int, ZataValue::from_bool(x.as_int() > y.as_int()))
+            ZVM_TARGET(B_ADD_FLOAT):
+                ZVM_QUICK_BINARY(is_float, ZataValue::from_float(x.as_float() + y.as_float()))
+            ZVM_TARGET(B_SUB_FLOAT):
+                ZVM_QUICK_BINARY(is_float, ZataValue::from_float(x.as_float() - y.as_float()))
+            ZVM_TARGET(B_EQ_FLOAT):
+                ZVM_QUICK_BINARY(is_float, ZataValue::from_bool(x.as_float() == y.as_float()))
+            ZVM_TARGET(B_LT_FLOAT):
+                ZVM_QUICK_BINARY(is_float, ZataValue::from_bool(x.as_float() < y.as_float()))
+            ZVM_TARGET(B_GT_FLOAT):
+                ZVM_QUICK_BINARY(is_float, ZataValue::from_bool(x.as_float() > y.as_float()))
+            ZVM_TARGET(B_ADD_FLOAT64):
+                ZVM_QUICK_BINARY(is_double, ZataValue::from_double(x.as_double() + y.as_double()))
+            ZVM_TARGET(B_LT_FLOAT64):
+                ZVM_QUICK_BINARY(is_double, ZataValue::from_bool(x.as_double() < y.as_double()))
+            ZVM_TARGET(B_GT_FLOAT64):
+                ZVM_QUICK_BINARY(is_double, ZataValue::from_bool(x.as_double() > y.as_double()))
+            ZVM_TARGET(U_CALC): {
+                int pattern = ZVM_ARG(0);
+                ZVM_SKIP(1);
+                ZataObjectPtr a_obj = box_value(this->op_stack.take());
+                auto* a_ptr = zata_cast<ZataBuiltinsClass>(a_obj);
                 if (!a_ptr) {
                     zata_vm_error_thrower(this->call_stack ,ZataError{
                         .name = "ZataRunTimeError",
@@ -166,88 +408,74 @@ public:
                     });
                 }
 
-                switch (pattern) {
-                    case 0:
-                        this->op_stack.emplace(a_ptr->object_type->type_neg({a_ptr}));
-                        break;
-                    case 1:
-                        this->op_stack.emplace(a_ptr->object_type->type_bit_not({a_ptr}));
-                        break;
-                    default: {
-                        zata_vm_error_thrower(this->call_stack ,ZataError{
-                        .name = "ZataRunTimeError",
-                        .message = "Unknown unary pattern opcode",
+                const auto* type = a_ptr->object_type();
+                const auto slot = type ? type->unary_slots[pattern] : nullptr;
+                ZataObjectPtr result = slot ? slot(a_ptr) : nullptr;
+                if (nullptr == result) {
+                    zata_vm_error_thrower(this->call_stack ,ZataError{
+                        .name = "ZataTypeError",
+                        .message = "<object id="+std::to_string(a_ptr->object_id())+">can not support op "+std::to_string(pattern),
                         .error_code = 0
                     });
-                    }if (nullptr == this->op_stack.top()) {
-                        zata_vm_error_thrower(this->call_stack ,ZataError{
-                            .name = "ZataTypeError",
-                            .message = "<object id="+std::to_string(a->object_id)+">can not support op "+std::to_string(pattern),
-                            .error_code = 0
-                        });
-                    }
                 }
-                break;
+                this->op_stack.push(unbox_object(std::move(result)));
+                ZVM_DISPATCH();
             }
-            case Opcode::SWAP: {
-                auto b = this->op_stack.top();
-                this->op_stack.pop();
-                auto a = this->op_stack.top();
-                this->op_stack.pop();
-                this->op_stack.emplace(b);
-                this->op_stack.emplace(a);
-                break;
+            ZVM_TARGET(SWAP): {
+                auto b = this->op_stack.take();
+                auto a = this->op_stack.take();
+                this->op_stack.push(std::move(b));
+                this->op_stack.push(std::move(a));
+                ZVM_DISPATCH();
             }
-            case Opcode::LOAD_CONST: {
-                int const_addr = co_code[this->pc];
-                this->pc += 1;
-                this->op_stack.emplace(this->constant_pool[const_addr]);
-                break;
+            ZVM_TARGET(LOAD_CONST): {
+                int const_addr = ZVM_ARG(0);
+                ZVM_SKIP(1);
+                this->op_stack.push(this->constant_pool[const_addr]);
+                ZVM_DISPATCH();
             }
-            case Opcode::LOAD_LOCAL: {
-                int var_addr = co_code[this->pc];
-                this->pc += 1;
-                this->op_stack.emplace(this->locals[var_addr]);
-                break;
+            ZVM_TARGET(LOAD_LOCAL): {
+                int var_addr = ZVM_ARG(0);
+                ZVM_SKIP(1);
+                this->op_stack.push(this->locals[var_addr]);
+                ZVM_DISPATCH();
             }
-            case Opcode::STORE_LOCAL: {
-                int var_addr = co_code[this->pc];
-                this->pc += 1;
+            ZVM_TARGET(STORE_LOCAL): {
+                int var_addr = ZVM_ARG(0);
+                ZVM_SKIP(1);
 
-                ZataObjectPtr val = this->op_stack.top();
-                this->op_stack.pop();
-                this->locals[var_addr] = val;
+                this->locals[var_addr] = this->op_stack.take();
 
-                break;
+                ZVM_DISPATCH();
             }
-            case Opcode::LOAD_GLOBAL: {
-                int var_addr = co_code[this->pc];
-                this->pc += 1;
-                this->op_stack.emplace(this->globals[var_addr]);
-                break;
+            ZVM_TARGET(LOAD_GLOBAL): {
+                int var_addr = ZVM_ARG(0);
+                ZVM_SKIP(1);
+                this->op_stack.push(this->globals[var_addr]);
+                ZVM_DISPATCH();
             }
-            case Opcode::STORE_GLOBAL: {
-                int var_addr = co_code[this->pc];
-                this->pc += 1;
-                ZataObjectPtr val = this->op_stack.top();
-                this->op_stack.pop();
-                this->globals[var_addr] = val;
-                break;
+            ZVM_TARGET(STORE_GLOBAL): {
+                int var_addr = ZVM_ARG(0);
+                ZVM_SKIP(1);
+                this->globals[var_addr] = this->op_stack.take();
+                ZVM_DISPATCH();
             }
-            case Opcode::JMP: {
-                int offset = co_code[this->pc];
-                this->pc += offset;
-                break;
+            ZVM_TARGET(JMP): {
+                int offset = ZVM_ARG(0);
+                // 向后跳转(循环)是安全点
+                if (offset < 0) {
+                    this->heap.safe_point();
+                }
+                ZVM_SKIP(offset);
+                ZVM_DISPATCH();
             }
-            case Opcode::JMP_IF_FALSE: {
-                int offset = co_code[this->pc];
-                ZataObjectPtr cond = this->op_stack.top();
-                this->op_stack.pop();
+            ZVM_TARGET(JMP_IF_FALSE): {
+                int offset = ZVM_ARG(0);
+                ZataValue cond = this->op_stack.take();
 
                 int condition = 2;
-                std::shared_ptr<ZataState> bool_obj_ptr = dynamic_pointer_cast<ZataState>(cond);
-                if(bool_obj_ptr) {
-                    condition = bool_obj_ptr->val;
+                if(cond.is_state()) {
+                    condition = cond.as_state();
                 }else {
                     zata_vm_error_thrower(this->call_stack ,ZataError{
                         .name = "ZataRunTimeError",
@@ -257,21 +485,19 @@ public:
                 }
 
                 if (condition != 1) {
-                    this->pc += offset;
+                    ZVM_SKIP(offset);
                 } else {
-                    this->pc += 1;
+                    ZVM_SKIP(1);
                 }
-                break;
+                ZVM_DISPATCH();
             }
-            case Opcode::JMP_IF_TRUE: {
-                int offset = co_code[this->pc];
-                ZataObjectPtr cond = this->op_stack.top();
-                this->op_stack.pop();
+            ZVM_TARGET(JMP_IF_TRUE): {
+                int offset = ZVM_ARG(0);
+                ZataValue cond = this->op_stack.take();
 
                 int condition = 2;
-                std::shared_ptr<ZataState> bool_obj_ptr = dynamic_pointer_cast<ZataState>(cond);
-                if(bool_obj_ptr) {
-                    condition = bool_obj_ptr->val;
+                if(cond.is_state()) {
+                    condition = cond.as_state();
                 }else {
                     zata_vm_error_thrower(this->call_stack ,ZataError{
                         .name = "ZataRunTimeError",
@@ -281,39 +507,71 @@ public:
                 }
 
                 if (condition == 1) {
-                    this->pc += offset;
+                    ZVM_SKIP(offset);
                 } else {
-                    this->pc += 1;
+                    ZVM_SKIP(1);
                 }
-                break;
+                ZVM_DISPATCH();
             }
-            case Opcode::NOP: {
-                // 空操作
-                break;
+            // 超级指令, 语义与展开后的指令序列相同
+            ZVM_TARGET(LOAD_LOCAL2): {
+                const int first = ZVM_ARG(0);
+                const int second = ZVM_ARG(1);
+                ZVM_SKIP(2);
+                this->op_stack.push(this->locals[first]);
+                this->op_stack.push(this->locals[second]);
+                ZVM_DISPATCH();
             }
-            case Opcode::CALL: {
-                int arg_count = co_code[this->pc];
-                this->pc += 1;
-
-
-                ZataObjectPtr fn = this->op_stack.top();
-                this->op_stack.pop();
-
-                // Prepare arguments
-                std::vector<ZataObjectPtr> fns_locals;
-                std::vector<ZataObjectPtr> args;
-
-                for(int i = 0; i < arg_count; ++i) {
-                    args.push_back(this->op_stack.top());
-                    this->op_stack.pop();
+            ZVM_TARGET(B_CALC_LOCAL_CONST): {
+                const ZataValue& a = this->locals[ZVM_ARG(0)];
+                const ZataValue& b = this->constant_pool[ZVM_ARG(1)];
+                const int pattern = ZVM_ARG(2);
+                ZVM_SKIP(3);
+                this->op_stack.push(this->binary(pattern, a, b));
+                ZVM_DISPATCH();
+            }
+            ZVM_TARGET(B_CALC_JMP_IF_FALSE): {
+                // 比较结果直接用于分支, 不经过操作数栈
+                const int pattern = ZVM_ARG(0);
+                const int offset = ZVM_ARG(1);
+                ZataValue b = this->op_stack.take();
+                ZataValue a = this->op_stack.take();
+                const ZataValue cond = this->binary(pattern, a, b);
+                if (!cond.is_state()) {
+                    zata_vm_error_thrower(this->call_stack ,ZataError{
+                        .name = "ZataRunTimeError",
+                        .message = "Top of the stack is not a bool object",
+                        .error_code = 0
+                    });
                 }
-                std::ranges::reverse(args);
-
-                for(int i = 0; i < arg_count; ++i) {
-                    fns_locals.push_back(args[i]);
+                if (cond.as_state() != 1) {
+                    ZVM_SKIP(1 + offset);
+                } else {
+                    ZVM_SKIP(2);
                 }
+                ZVM_DISPATCH();
+            }
+            ZVM_TARGET(GET_LOCAL_ATTR): {
+                const int var_addr = ZVM_ARG(0);
+                const int field_addr = ZVM_ARG(1);
+                const size_t site = ZVM_SITE();
+                ZVM_SKIP(2);
+                this->op_stack.push(this->get_attr(this->locals[var_addr], field_addr, site));
+                ZVM_DISPATCH();
+            }
+            ZVM_TARGET(NOP): {
+                // 空操作
+                ZVM_DISPATCH();
+            }
+            ZVM_TARGET(CALL): {
+                // 安全点: 此时函数和参数都还在操作数栈上
+                this->heap.safe_point();
+                int arg_count = ZVM_ARG(0);
+                ZVM_SKIP(1);
+
+                ZataValue fn = this->op_stack.take();
 
-                auto fn_ptr = std::dynamic_pointer_cast<ZataFunction>(fn);
+                auto* fn_ptr = zata_cast<ZataFunction>(fn.as_object());
 
                 if (!fn_ptr) {
                     zata_vm_error_thrower(this->call_stack ,ZataError{
@@ -323,57 +581,83 @@ public:
                     });
                 }
 
-                // Check is in builtins
-                auto it = BuiltinsFunction.find(fn_ptr->object_name);
-                if (it != BuiltinsFunction.end()) {
-                    this->op_stack.emplace(it->second(args));
-                    break;
+                // 运行中才出现或链接后被改动的函数对象在调用前(重新)链接, 同时校验其代码
+                if (!function_linked(*fn_ptr, this->globals.size())) {
+                    link_function(*fn_ptr, this->globals.size());
                 }
 
-                fn_ptr->code->locals = fns_locals;
-
-                CallFrame frame{
-                    .pc = this->pc,
-                    .locals = this->locals,
-                    .return_address = this->pc,
-                    .name = fn_ptr->object_name,
-                    .code_object = code_object,
-                };
-
-                this->call_stack.push(frame);
-                this->pc = 0;
+                if (fn_ptr->native) {
+                    std::vector<ZataObjectPtr> args(arg_count);
+                    for(int i = arg_count - 1; i >= 0; --i) {
+                        args[i] = box_value(this->op_stack.take());
+                    }
+                    this->op_stack.push(unbox_object(fn_ptr->native(args)));
+                    // 原生函数可能改写了参数对象
+                    for (auto* arg : args) {
+                        this->heap.write_barrier(arg);
+                    }
+                    ZVM_DISPATCH();
+                }
 
-                this->co_code = fn_ptr->code->co_code;
-                this->locals = fns_locals;
-                this->constant_pool = fn_ptr->code->consts;
+                if (!fn_ptr->code) {
+                    zata_vm_error_thrower(this->call_stack ,ZataError{
+                        .name = "ZataRunTimeError",
+                        .message = "CALL opcode: function " + fn_ptr->object_name + " has no code object",
+                        .error_code = 0
+                    });
+                }
 
-                break;
-            }
-            case Opcode::RET: {
-                if (!this->call_stack.empty()) {
-                    CallFrame frame = this->call_stack.top();
-                    this->call_stack.pop();
-
-                    this->locals = frame.locals;
-                    this->constant_pool = frame.code_object->consts;
-                    this->co_code = frame.code_object->co_code;
-                    this->pc = frame.return_address;
-                } else {
+                // 校验器按函数声明的arg_count检查局部变量窗口, 参数个数不一致时窗口可能比校验时小
+                if (arg_count != fn_ptr->arg_count) {
                     zata_vm_error_thrower(this->call_stack ,ZataError{
                         .name = "ZataRunTimeError",
-                        .message = "RET opcode: call stack is empty",
+                        .message = "CALL opcode: function " + fn_ptr->object_name + " takes " +
+                                   std::to_string(fn_ptr->arg_count) + " arguments but " +
+                                   std::to_string(arg_count) + " were given",
                         .error_code = 0
                     });
                 }
-                break;
+
+                // 新帧的局部变量窗口直接开在value_stack上, 参数从操作数栈搬进去
+                // 整个过程与co_code/consts的大小无关
+                ZVM_SYNC_PC();
+                ZataCodeObject* callee = fn_ptr->code;
+                const std::string_view name = fn_ptr->object_name;
+                this->op_stack.reserve(code_max_stack(*callee));
+                this->push_frame(callee, fn.take_object(), name, arg_count);
+
+                ZataValue* window = this->value_stack.data() + this->call_stack.top().locals_base;
+                for(int i = arg_count - 1; i >= 0; --i) {
+                    window[i] = this->op_stack.take();
+                }
+
+                this->pc = 0;
+                this->load_frame();
+                ZVM_LOAD_CODE(this->code);
+                ZVM_DISPATCH();
             }
-            case Opcode::MAKE_INSTANCE: {
-                int class_addr = co_code[this->pc];
-                this->pc += 1;
+            ZVM_TARGET(RET): {
+                // 返回值留在操作数栈上, 这里只需丢弃当前帧的局部变量窗口
+                const CallFrame& frame = this->call_stack.top();
+                const size_t base = frame.locals_base;
+                this->pc = frame.return_address;
+                this->call_stack.pop();
+                this->value_stack.resize(base);
+
+                // 本次exec的入口帧返回 -> 交还给调用exec的地方
+                if (this->call_stack.size() == entry_depth) {
+                    goto vm_exit;
+                }
 
-                ZataObjectPtr class_obj = this->constant_pool[class_addr];
+                this->load_frame();
+                ZVM_LOAD_CODE(this->code);
+                ZVM_DISPATCH();
+            }
+            ZVM_TARGET(MAKE_INSTANCE): {
+                int class_addr = ZVM_ARG(0);
+                ZVM_SKIP(1);
 
-                std::shared_ptr<ZataClass> class_ptr = std::dynamic_pointer_cast<ZataClass>(class_obj);
+                auto* class_ptr = zata_cast<ZataClass>(this->constant_pool[class_addr].as_object());
 
                 if (!class_ptr) {
                     zata_vm_error_thrower(this->call_stack ,ZataError{
@@ -383,24 +667,44 @@ public:
                     });
                 }
 
-                std::shared_ptr<ZataInstance> class_instance = std::make_shared<ZataInstance>();
-                this->exec(class_instance->object_type->type_new->code);
+                // 新实例还不在任何根里, 重入exec期间用句柄固定住
+                ZataHandle<ZataInstance> class_instance(new ZataInstance());
+                const ZataUserType* user_type = class_instance->object_type;
+                ZataFunction* type_new = user_type ? user_type->type_new : nullptr;
+                if (type_new && type_new->code) {
+                    // type_new不在常量池里, 没有经过模块链接, 重入exec之前先优化并校验
+                    // 它在无参数的新帧中执行, 返回值随后被丢弃
+                    prepare_code(*type_new->code, ZataVerifyContext{.global_count = this->globals.size()});
+                    ZVM_SYNC_PC();
+                    const size_t depth = this->op_stack.size();
+                    this->exec(type_new->code, type_new->object_name);
+                    if (!this->running) {
+                        goto vm_exit;
+                    }
+                    // type_new留下的返回值不是实例, 丢弃(校验器按MAKE_INSTANCE净压入一个值计算栈深度)
+                    while (this->op_stack.size() > depth) {
+                        this->op_stack.pop();
+                    }
+                    this->load_frame();
+                    ZVM_LOAD_CODE(this->code);
+                }
+
                 class_instance->ref_class = class_ptr;
-                class_instance->fields = {};
-                this->op_stack.emplace(class_instance);
-                break;
+                class_instance->shape = class_ptr->instance_shape();
+                class_instance->slots.clear();
+                this->op_stack.push(ZataValue::from_object(class_instance.get()));
+                ZVM_DISPATCH();
             }
-            case Opcode::SET_ATTR: {
-                int field_addr = co_code[this->pc];
-                this->pc += 1;
+            ZVM_TARGET(SET_ATTR): {
+                int field_addr = ZVM_ARG(0);
+                const size_t site = ZVM_SITE();
+                ZVM_SKIP(1);
 
-                ZataObjectPtr obj = this->op_stack.top();
-                this->op_stack.pop();
+                ZataValue obj = this->op_stack.take();
 
-                ZataObjectPtr value = this->op_stack.top();
-                this->op_stack.pop();
+                ZataValue value = this->op_stack.take();
 
-                std::shared_ptr<ZataInstance> instance = std::dynamic_pointer_cast<ZataInstance>(obj);
+                auto* instance = zata_cast<ZataInstance>(obj.as_object());
                 if (!instance) {
                     zata_vm_error_thrower(this->call_stack ,ZataError{
                         .name = "ZataRunTimeError",
@@ -409,73 +713,56 @@ public:
                     });
                 }
 
-                auto name = instance->names.at(field_addr);
-                instance->fields[name] = value;
-                break;
-            }
-            case Opcode::GET_ATTR: {
-                int field_addr = co_code[this->pc];
-                this->pc += 1;
-
-                ZataObjectPtr obj = this->op_stack.top();
-                this->op_stack.pop();
-
-                std::shared_ptr<ZataInstance> instance_ptr = std::dynamic_pointer_cast<ZataInstance>(obj);
-                if (instance_ptr) {
-                    auto name = instance_ptr->names.at(field_addr);
-                    this->op_stack.emplace(instance_ptr->fields[name]);
-                    break;
+                this->heap.write_barrier(instance, value);
+
+                // 内联缓存命中: 已有字段直接写槽位, 新增字段直接切换到缓存的下一个shape
+                ZataAttrCache& cache = this->attr_cache(site);
+                const bool cacheable = instance->cacheable();
+                if (const auto* entry = cacheable ? cache.find(instance->shape.get()) : nullptr) {
+                    if (entry->next) {
+                        instance->shape = entry->next;
+                        instance->slots.push_back(std::move(value));
+                    } else {
+                        instance->slots[entry->slot] = std::move(value);
+                    }
+                    ZVM_DISPATCH();
                 }
 
-                // 再尝试转换为ZataClass
-                std::shared_ptr<ZataClass> class_ptr = std::dynamic_pointer_cast<ZataClass>(obj);
-                if (class_ptr) {
-                    auto name = class_ptr->names.at(field_addr);
-                    this->op_stack.emplace(class_ptr->attrs[name]);
-                    break;
+                const std::string& name = instance->field_names().at(field_addr);
+                ZataShapeRef before = instance->shape;
+                instance->set_field(name, std::move(value));
+                if (cacheable) {
+                    const bool added = before != instance->shape;
+                    cache.insert(before, instance->find_field(name), added ? instance->shape : nullptr);
                 }
-
-                zata_vm_error_thrower(this->call_stack ,ZataError{
-                        .name = "ZataRunTimeError",
-                        .message = "GET_ATTR: object is not ZataInstance or ZataClass",
-                        .error_code = 0
-                    });
-                break;
+                ZVM_DISPATCH();
             }
-            case Opcode::POP: {
-                if(!this->op_stack.empty()) {
-                    this->op_stack.pop();
-                } else {
-                    zata_vm_error_thrower(this->call_stack ,ZataError{
-                        .name = "ZataRunTimeError",
-                        .message = "POP opcode: stack underflow",
-                        .error_code = 0
-                    });
-                }
-                break;
+            ZVM_TARGET(GET_ATTR): {
+                int field_addr = ZVM_ARG(0);
+                const size_t site = ZVM_SITE();
+                ZVM_SKIP(1);
+
+                ZataValue obj = this->op_stack.take();
+                this->op_stack.push(this->get_attr(obj, field_addr, site));
+                ZVM_DISPATCH();
             }
-            case Opcode::DUP: {
-                if(!this->op_stack.empty()) {
-                    ZataObjectPtr a = this->op_stack.top();
-                    this->op_stack.emplace(a);
-                } else {
-                    zata_vm_error_thrower(this->call_stack ,ZataError{
-                        .name = "ZataRunTimeError",
-                        .message = "DUP opcode: stack underflow",
-                        .error_code = 0
-                    });
-                }
-                break;
+            ZVM_TARGET(POP): {
+                this->op_stack.pop();
+                ZVM_DISPATCH();
+            }
+            ZVM_TARGET(DUP): {
+                ZataValue a = this->op_stack.top();
+                this->op_stack.push(std::move(a));
+                ZVM_DISPATCH();
             }
-            case Opcode::LOAD_SLL: {
-                int fn_addr = co_code[this->pc];
-                int arg_count = co_code[this->pc+1];
-                this->pc += 2;
+            ZVM_TARGET(LOAD_SLL): {
+                int fn_addr = ZVM_ARG(0);
+                int arg_count = ZVM_ARG(1);
+                ZVM_SKIP(2);
 
-                ZataObjectPtr sll_module = this->op_stack.top();
-                this->op_stack.pop();
+                ZataValue sll_module = this->op_stack.take();
 
-                auto sll_module_ptr = std::dynamic_pointer_cast<ZataModule>(sll_module);
+                auto* sll_module_ptr = zata_cast<ZataModule>(sll_module.as_object());
 
                 if (!sll_module_ptr) {
                     zata_vm_error_thrower(this->call_stack ,ZataError{
@@ -488,31 +775,45 @@ public:
                 // Prepare arguments
                 std::vector<ZataObjectPtr> args;
                 for(int i = 0; i < arg_count; ++i) {
-                    args.push_back(this->op_stack.top());
-                    this->op_stack.pop();
+                    args.push_back(box_value(this->op_stack.take()));
                 }
                 std::ranges::reverse(args);
 
-                auto functions  = load_sll(sll_module_ptr->module_path, sll_module_ptr->exports);
-                auto fn_name = sll_module_ptr->exports.at(fn_addr);
-                auto result = functions[fn_name](args);
-                this->op_stack.emplace(result);
+                // 库和符号只在第一次调用时加载/解析
+                const ZataDllFunction function = resolve_sll_export(*sll_module_ptr, fn_addr);
+                auto result = function(args);
+                this->op_stack.push(unbox_object(std::move(result)));
+                for (auto* arg : args) {
+                    this->heap.write_barrier(arg);
+                }
+                ZVM_DISPATCH();
             }
-            case Opcode::HALT: {
+#if ZVM_COMPUTED_GOTO
+            op_END:  // 哨兵: 执行到co_code末尾
+#endif
+            ZVM_TARGET(HALT): {
                 this->running = false;
-                break;
+                goto vm_exit;
             }
-            default: {
+            ZVM_DEFAULT: {
+#if ZVM_COMPUTED_GOTO
+                const int opcode = ip[-1].operand;
+#endif
                 zata_vm_error_thrower(this->call_stack ,ZataError{
                         .name = "ZataRunTimeError",
                         .message = "Unknown opcode: " + std::to_string(opcode),
                         .error_code = 0
                     });
+                goto vm_exit;
             }
+#if ZVM_COMPUTED_GOTO
+        }
+#else
             }
         }
-
-        return this->op_stack;
+#endif
+    vm_exit:
+        return;
     }
 };
 
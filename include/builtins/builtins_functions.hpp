@@ -2,13 +2,18 @@
 #define ZVM_OPCODES_H
 #include <ios>
 #include <iostream>
+
+#ifdef _WIN32
 #include <windows.h>
+#else
+#include <ctime>
+#endif
 
 #include "builtins_type.hpp"
 #include "models/Errors.hpp"
 
 inline ZataObjectPtr zata_print(const std::vector<ZataObjectPtr>& arguments) {
-    auto target = std::dynamic_pointer_cast<ZataBuiltinsClass>(arguments[0]);
+    auto* target = zata_cast<ZataBuiltinsClass>(arguments[0]);
     if (!target) {
         zata_vm_error_thrower({}, ZataError{
             .name = "ZataTypeError",
@@ -18,7 +23,8 @@ inline ZataObjectPtr zata_print(const std::vector<ZataObjectPtr>& arguments) {
     }
 
     // 检查是否有type_str方法
-    if (!target->object_type || !target->object_type->type_str) {
+    const auto* type = target->object_type();
+    if (!type || !type->type_str) {
         zata_vm_error_thrower({}, ZataError{
             .name = "ZataRunTimeError",
             .message = "Can't print object without __str__ method",
@@ -27,7 +33,7 @@ inline ZataObjectPtr zata_print(const std::vector<ZataObjectPtr>& arguments) {
     }
 
     // 调用type_str获取字符串表示
-    auto str_obj = target->object_type->type_str({target});
+    auto str_obj = type->type_str(target);
     if (!str_obj) {
         zata_vm_error_thrower({}, ZataError{
             .name = "ZataRunTimeError",
@@ -37,7 +43,7 @@ inline ZataObjectPtr zata_print(const std::vector<ZataObjectPtr>& arguments) {
     }
 
     // 打印
-    auto str_val = std::dynamic_pointer_cast<ZataString>(str_obj);
+    auto* str_val = zata_cast<ZataString>(str_obj);
     if (!str_val) {
         zata_vm_error_thrower({}, ZataError{
             .name = "ZataTypeError",
@@ -47,13 +53,11 @@ inline ZataObjectPtr zata_print(const std::vector<ZataObjectPtr>& arguments) {
     }
     std::cout << str_val->val << std::endl;
 
-    auto none = std::make_shared<ZataState>();
-    none->val = 2;
-    return none;
+    return create_state(2);
 }
 
 inline ZataObjectPtr zata_input(const std::vector<ZataObjectPtr>& arguments) {
-    const auto prompt = std::dynamic_pointer_cast<ZataString>(arguments[0]);
+    const auto* prompt = zata_cast<ZataString>(arguments[0]);
     std::cout << prompt->val;
     std::string input;
     std::getline(std::cin, input);
@@ -77,7 +81,7 @@ inline ZataObjectPtr zata_now(const std::vector<ZataObjectPtr>& arguments) {
     // 类 Unix 平台
     struct timespec ts;
     clock_gettime(CLOCK_MONOTONIC, &ts);  // 使用单调时钟
-    return (float)ts.tv_sec + (float)ts.tv_nsec / 1000000000.0f;
+    return create_float((float)ts.tv_sec + (float)ts.tv_nsec / 1000000000.0f);
     #endif
 }
 #endif
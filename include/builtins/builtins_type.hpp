@@ -1,5 +1,6 @@
 #ifndef BUILTINS_TYPE_HPP
 #define BUILTINS_TYPE_HPP
+#include <array>
 #include <iostream>
 #include <memory>
 #include <vector>
@@ -8,110 +9,118 @@
 #include "models/Objects.hpp"
 
 // 提前声明魔术方法（避免未定义错误）
-inline ZataObjectPtr int_add(const std::vector<ZataObjectPtr>& args);
-inline ZataObjectPtr int_sub(const std::vector<ZataObjectPtr>& args);
-inline ZataObjectPtr int_mul(const std::vector<ZataObjectPtr>& args);
-inline ZataObjectPtr int_div(const std::vector<ZataObjectPtr>& args);
-inline ZataObjectPtr int_eq(const std::vector<ZataObjectPtr>& args);
-inline ZataObjectPtr str_add(const std::vector<ZataObjectPtr>& args);
-inline ZataObjectPtr str_eq(const std::vector<ZataObjectPtr>& args);
-inline ZataObjectPtr int64_add(const std::vector<ZataObjectPtr>& args);
-inline ZataObjectPtr int64_sub(const std::vector<ZataObjectPtr>& args);
-inline ZataObjectPtr int64_eq(const std::vector<ZataObjectPtr>& args);
-inline ZataObjectPtr float_add(const std::vector<ZataObjectPtr>& args);
-inline ZataObjectPtr float_sub(const std::vector<ZataObjectPtr>& args);
-inline ZataObjectPtr float_eq(const std::vector<ZataObjectPtr>& args);
-inline ZataObjectPtr float64_add(const std::vector<ZataObjectPtr>& args);
-
-inline ZataObjectPtr int_gt(const std::vector<ZataObjectPtr>& args);
-inline ZataObjectPtr int_lt(const std::vector<ZataObjectPtr>& args);
-inline ZataObjectPtr int64_gt(const std::vector<ZataObjectPtr>& args);
-inline ZataObjectPtr int64_lt(const std::vector<ZataObjectPtr>& args);
-inline ZataObjectPtr float_gt(const std::vector<ZataObjectPtr>& args);
-inline ZataObjectPtr float_lt(const std::vector<ZataObjectPtr>& args);
-inline ZataObjectPtr float64_gt(const std::vector<ZataObjectPtr>& args);
-inline ZataObjectPtr float64_lt(const std::vector<ZataObjectPtr>& args);
-
-inline ZataObjectPtr dict_getitem(const std::vector<ZataObjectPtr>& args);
-inline ZataObjectPtr dict_setitem(const std::vector<ZataObjectPtr>& args);
-inline ZataObjectPtr tuple_getitem(const std::vector<ZataObjectPtr>& args);
-inline ZataObjectPtr list_add(const std::vector<ZataObjectPtr>& args);
-inline ZataObjectPtr list_getitem(const std::vector<ZataObjectPtr>& args);
+inline ZataObjectPtr int_add(ZataObject* lhs, ZataObject* rhs);
+inline ZataObjectPtr int_sub(ZataObject* lhs, ZataObject* rhs);
+inline ZataObjectPtr int_mul(ZataObject* lhs, ZataObject* rhs);
+inline ZataObjectPtr int_div(ZataObject* lhs, ZataObject* rhs);
+inline ZataObjectPtr int_eq(ZataObject* lhs, ZataObject* rhs);
+inline ZataObjectPtr str_add(ZataObject* lhs, ZataObject* rhs);
+inline ZataObjectPtr str_eq(ZataObject* lhs, ZataObject* rhs);
+inline ZataObjectPtr int64_add(ZataObject* lhs, ZataObject* rhs);
+inline ZataObjectPtr int64_sub(ZataObject* lhs, ZataObject* rhs);
+inline ZataObjectPtr int64_eq(ZataObject* lhs, ZataObject* rhs);
+inline ZataObjectPtr float_add(ZataObject* lhs, ZataObject* rhs);
+inline ZataObjectPtr float_sub(ZataObject* lhs, ZataObject* rhs);
+inline ZataObjectPtr float_eq(ZataObject* lhs, ZataObject* rhs);
+inline ZataObjectPtr float64_add(ZataObject* lhs, ZataObject* rhs);
+
+inline ZataObjectPtr int_gt(ZataObject* lhs, ZataObject* rhs);
+inline ZataObjectPtr int_lt(ZataObject* lhs, ZataObject* rhs);
+inline ZataObjectPtr int64_gt(ZataObject* lhs, ZataObject* rhs);
+inline ZataObjectPtr int64_lt(ZataObject* lhs, ZataObject* rhs);
+inline ZataObjectPtr float_gt(ZataObject* lhs, ZataObject* rhs);
+inline ZataObjectPtr float_lt(ZataObject* lhs, ZataObject* rhs);
+inline ZataObjectPtr float64_gt(ZataObject* lhs, ZataObject* rhs);
+inline ZataObjectPtr float64_lt(ZataObject* lhs, ZataObject* rhs);
+
+inline ZataObjectPtr dict_getitem(ZataObject* container, const ZataObjectPtr& key);
+inline ZataObjectPtr dict_setitem(ZataObject* container, const ZataObjectPtr& key, const ZataObjectPtr& value);
+inline ZataObjectPtr tuple_getitem(ZataObject* container, const ZataObjectPtr& key);
+inline ZataObjectPtr list_add(ZataObject* lhs, ZataObject* rhs);
+inline ZataObjectPtr list_getitem(ZataObject* container, const ZataObjectPtr& key);
 
 // 提前声明type_str方法
-inline ZataObjectPtr int_str(const std::vector<ZataObjectPtr>& args);
-inline ZataObjectPtr str_str(const std::vector<ZataObjectPtr>& args);
-inline ZataObjectPtr int64_str(const std::vector<ZataObjectPtr>& args);
-inline ZataObjectPtr float_str(const std::vector<ZataObjectPtr>& args);
-inline ZataObjectPtr float64_str(const std::vector<ZataObjectPtr>& args);
+inline ZataObjectPtr int_str(ZataObject* obj);
+inline ZataObjectPtr str_str(ZataObject* obj);
+inline ZataObjectPtr int64_str(ZataObject* obj);
+inline ZataObjectPtr float_str(ZataObject* obj);
+inline ZataObjectPtr float64_str(ZataObject* obj);
 
 
 // -------------------------- 类型绑定 --------------------------
 
 // 整数类型绑定
-inline auto int_type = std::make_shared<ZataBuiltinsType>();
+// 内置类型对象存活于整个进程, 创建时就设为不朽对象(不会被回收), 并登记为kind对应的类型
+inline ZataBuiltinsType* new_builtins_type(const ZataKind kind) {
+    auto* type = new ZataBuiltinsType();
+    ZataHeap::instance().make_immortal(type);
+    builtins_types[static_cast<size_t>(kind)] = type;
+    return type;
+}
+
+inline auto int_type = new_builtins_type(ZataKind::Int);
 inline void bind_int_type() {
-    int_type->type_add = int_add;
-    int_type->type_sub = int_sub;
-    int_type->type_mul = int_mul;
-    int_type->type_div = int_div;
-    int_type->type_eq = int_eq;
+    int_type->binary_slots[ZataSlot::ADD] = int_add;
+    int_type->binary_slots[ZataSlot::SUB] = int_sub;
+    int_type->binary_slots[ZataSlot::MUL] = int_mul;
+    int_type->binary_slots[ZataSlot::DIV] = int_div;
+    int_type->binary_slots[ZataSlot::EQ] = int_eq;
     int_type->type_str = int_str;  // 绑定type_str
-    int_type->type_gt = int_gt;
-    int_type->type_lt = int_lt;
+    int_type->binary_slots[ZataSlot::GT] = int_gt;
+    int_type->binary_slots[ZataSlot::LT] = int_lt;
     int_type->type_str = int_str;
 }
 
 // 字符串类型绑定
-inline auto str_type = std::make_shared<ZataBuiltinsType>();
+inline auto str_type = new_builtins_type(ZataKind::String);
 inline void bind_str_type() {
-    str_type->type_add = str_add;
-    str_type->type_eq = str_eq;
+    str_type->binary_slots[ZataSlot::ADD] = str_add;
+    str_type->binary_slots[ZataSlot::EQ] = str_eq;
     str_type->type_str = str_str;  // 绑定type_str
 }
 
 // 列表类型绑定
-inline auto list_type = std::make_shared<ZataBuiltinsType>();
+inline auto list_type = new_builtins_type(ZataKind::List);
 inline void bind_list_type() {
-    list_type->type_add = list_add;
+    list_type->binary_slots[ZataSlot::ADD] = list_add;
     list_type->type_getitem = list_getitem;
     // 若实现了list_str，需在此绑定：list_type->type_str = list_str;
 }
 
 // 长整数类型绑定
-inline auto int64_type = std::make_shared<ZataBuiltinsType>();
+inline auto int64_type = new_builtins_type(ZataKind::Int64);
 inline void bind_int64_type() {
-    int64_type->type_add = int64_add;
-    int64_type->type_sub = int64_sub;
-    int64_type->type_eq = int64_eq;
+    int64_type->binary_slots[ZataSlot::ADD] = int64_add;
+    int64_type->binary_slots[ZataSlot::SUB] = int64_sub;
+    int64_type->binary_slots[ZataSlot::EQ] = int64_eq;
     int64_type->type_str = int64_str;  // 绑定type_str
-    int64_type->type_gt = int64_gt;
-    int64_type->type_lt = int64_lt;
+    int64_type->binary_slots[ZataSlot::GT] = int64_gt;
+    int64_type->binary_slots[ZataSlot::LT] = int64_lt;
 }
 
 // 浮点数类型绑定
-inline auto float_type = std::make_shared<ZataBuiltinsType>();
+inline auto float_type = new_builtins_type(ZataKind::Float);
 inline void bind_float_type() {
-    float_type->type_add = float_add;
-    float_type->type_sub = float_sub;
-    float_type->type_eq = float_eq;
+    float_type->binary_slots[ZataSlot::ADD] = float_add;
+    float_type->binary_slots[ZataSlot::SUB] = float_sub;
+    float_type->binary_slots[ZataSlot::EQ] = float_eq;
     float_type->type_str = float_str;  // 绑定type_str
-    float_type->type_gt = float_gt;
-    float_type->type_lt = float_lt;
+    float_type->binary_slots[ZataSlot::GT] = float_gt;
+    float_type->binary_slots[ZataSlot::LT] = float_lt;
     float_type->type_str = float_str;
 }
 
 // 双精度浮点数类型绑定
-inline auto float64_type = std::make_shared<ZataBuiltinsType>();
+inline auto float64_type = new_builtins_type(ZataKind::Float64);
 inline void bind_float64_type() {
-    float64_type->type_add = float64_add;
-    float64_type->type_gt = float64_gt;
-    float64_type->type_lt = float64_lt;
+    float64_type->binary_slots[ZataSlot::ADD] = float64_add;
+    float64_type->binary_slots[ZataSlot::GT] = float64_gt;
+    float64_type->binary_slots[ZataSlot::LT] = float64_lt;
     float64_type->type_str = float64_str;  // 绑定type_str
 }
 
 // 字典类型绑定
-inline auto dict_type = std::make_shared<ZataBuiltinsType>();
+inline auto dict_type = new_builtins_type(ZataKind::Dict);
 inline void bind_dict_type() {
     dict_type->type_getitem = dict_getitem;
     dict_type->type_setitem = dict_setitem;
@@ -119,7 +128,7 @@ inline void bind_dict_type() {
 }
 
 // 元组类型绑定
-inline auto tuple_type = std::make_shared<ZataBuiltinsType>();
+inline auto tuple_type = new_builtins_type(ZataKind::Tuple);
 inline void bind_tuple_type() {
     tuple_type->type_getitem = tuple_getitem;
     // 若实现了tuple_str，需在此绑定：tuple_type->type_str = tuple_str;
@@ -137,343 +146,380 @@ inline void init_type_system() {
     bind_tuple_type();     // 元组
 }
 
+// -------------------------- 不朽对象 --------------------------
+
+// 四个状态值, 小整数, 空字符串, 空元组预先创建成不朽对象, create_*遇到这些值时直接返回它们
+// 这些对象被所有使用者共享, 不能改写(列表可变, 所以没有共享的空列表)
+constexpr int SMALL_INT_MIN = -5;
+constexpr int SMALL_INT_MAX = 1024;
+
+template <typename T>
+T* new_immortal() {
+    auto* obj = new T();
+    ZataHeap::instance().make_immortal(obj);
+    return obj;
+}
+
+inline const auto immortal_states = [] {
+    std::array<ZataState*, 4> states{};
+    for (int i = 0; i < 4; ++i) {
+        states[i] = new_immortal<ZataState>();
+        states[i]->val = i;
+    }
+    return states;
+}();
+
+inline const auto small_ints = [] {
+    std::array<ZataInt*, SMALL_INT_MAX - SMALL_INT_MIN + 1> ints{};
+    for (int i = 0; i < static_cast<int>(ints.size()); ++i) {
+        ints[i] = new_immortal<ZataInt>();
+        ints[i]->val = SMALL_INT_MIN + i;
+    }
+    return ints;
+}();
+
+inline ZataString* const empty_str = new_immortal<ZataString>();
+inline ZataTuple* const empty_tuple = new_immortal<ZataTuple>();
+
 // -------------------------- 对象创建函数 --------------------------
 
 // 创建整数对象
-inline std::shared_ptr<ZataInt> create_int(int val) {
-    auto obj = std::make_shared<ZataInt>();
+inline ZataInt* create_int(int val) {
+    if (val >= SMALL_INT_MIN && val <= SMALL_INT_MAX) {
+        return small_ints[val - SMALL_INT_MIN];
+    }
+    auto obj = new ZataInt();
     obj->val = val;
-    obj->object_type = int_type;
     return obj;
 }
 
 // 创建字符串对象
-inline std::shared_ptr<ZataString> create_str(const std::string& val) {
-    auto obj = std::make_shared<ZataString>();
+inline ZataString* create_str(const std::string& val) {
+    if (val.empty()) {
+        return empty_str;
+    }
+    auto obj = new ZataString();
     obj->val = val;
-    obj->object_type = str_type;
     return obj;
 }
 
 // 创建列表对象
-inline std::shared_ptr<ZataList> create_list() {
-    auto obj = std::make_shared<ZataList>();
+inline ZataList* create_list() {
+    auto obj = new ZataList();
     obj->size = 0;
-    obj->object_type = list_type;
     return obj;
 }
 
 // 创建长整数对象
-inline std::shared_ptr<ZataInt64> create_int64(long long val) {
-    auto obj = std::make_shared<ZataInt64>();
+inline ZataInt64* create_int64(long long val) {
+    auto obj = new ZataInt64();
     obj->val = val;
-    obj->object_type = int64_type;
     return obj;
 }
 
 // 创建浮点数对象
-inline std::shared_ptr<ZataFloat> create_float(float val) {
-    auto obj = std::make_shared<ZataFloat>();
+inline ZataFloat* create_float(float val) {
+    auto obj = new ZataFloat();
     obj->val = val;
-    obj->object_type = float_type;
     return obj;
 }
 
 // 创建双精度浮点数对象
-inline std::shared_ptr<ZataFloat64> create_float64(double val) {
-    auto obj = std::make_shared<ZataFloat64>();
+inline ZataFloat64* create_float64(double val) {
+    auto obj = new ZataFloat64();
     obj->val = val;
-    obj->object_type = float64_type;
     return obj;
 }
 
 // 创建字典对象
-inline std::shared_ptr<ZataDict> create_dict() {
-    auto obj = std::make_shared<ZataDict>();
-    obj->object_type = dict_type;
+inline ZataDict* create_dict() {
+    auto obj = new ZataDict();
     return obj;
 }
 
 // 创建元组对象（从向量初始化）
-inline std::shared_ptr<ZataTuple> create_tuple(const std::vector<ZataObjectPtr>& items) {
-    auto obj = std::make_shared<ZataTuple>();
+inline ZataTuple* create_tuple(const std::vector<ZataObjectPtr>& items) {
+    if (items.empty()) {
+        return empty_tuple;
+    }
+    auto obj = new ZataTuple();
     obj->items = items;
-    obj->object_type = tuple_type;
     return obj;
 }
 
+// 创建状态对象
+inline ZataState* create_state(int val) {
+    if (val >= 0 && val < static_cast<int>(immortal_states.size())) {
+        return immortal_states[val];
+    }
+    auto obj = new ZataState();
+    obj->val = val;
+    return obj;
+}
+
+// -------------------------- 装箱/拆箱 --------------------------
+
+// 对象 -> 虚拟机值: 整数/浮点数/状态拆成立即数, 其它对象保持引用
+inline ZataValue unbox_object(const ZataObjectPtr obj) {
+    ZataObject* raw = obj;
+    if (!raw) return {};
+    switch (raw->kind) {
+        case ZataKind::Int: return ZataValue::from_int(static_cast<ZataInt*>(raw)->val);
+        case ZataKind::Float: return ZataValue::from_float(static_cast<ZataFloat*>(raw)->val);
+        case ZataKind::Float64: return ZataValue::from_double(static_cast<ZataFloat64*>(raw)->val);
+        case ZataKind::State: return ZataValue::from_state(static_cast<ZataState*>(raw)->val);
+        default: return ZataValue::from_object(obj);
+    }
+}
+
+// 虚拟机值 -> 对象: 立即数在这里才真正分配对象, 只在值离开虚拟机时发生(返回给Python/存入容器等)
+inline ZataObjectPtr box_value(const ZataValue& value) {
+    switch (value.tag()) {
+        case ZataValue::Tag::Int: return create_int(value.as_int());
+        case ZataValue::Tag::Float: return create_float(value.as_float());
+        case ZataValue::Tag::Double: return create_float64(value.as_double());
+        case ZataValue::Tag::State: return create_state(value.as_state());
+        case ZataValue::Tag::Object: return value.object_ref();
+        default: return nullptr;
+    }
+}
+
+inline ZataObjectPtr box_value(ZataValue&& value) {
+    if (value.is_object()) {
+        return value.take_object();
+    }
+    return box_value(static_cast<const ZataValue&>(value));
+}
+
 // -------------------------- 魔术方法实现 --------------------------
 
 // 整数加法
-inline ZataObjectPtr int_add(const std::vector<ZataObjectPtr>& args) {
-    auto self = std::dynamic_pointer_cast<ZataInt>(args[0]);
-    auto other = std::dynamic_pointer_cast<ZataInt>(args[1]);
+inline ZataObjectPtr int_add(ZataObject* lhs, ZataObject* rhs) {
+    auto* self = zata_cast<ZataInt>(lhs);
+    auto* other = zata_cast<ZataInt>(rhs);
     if (!self || !other) return nullptr;
 
-    auto result = std::make_shared<ZataInt>();
-    result->val = self->val + other->val;
-    result->object_type = int_type;  // 补充结果的类型绑定
-    return result;
+    return create_int(self->val + other->val);
 }
 
 // 整数减法
-inline ZataObjectPtr int_sub(const std::vector<ZataObjectPtr>& args) {
-    auto self = std::dynamic_pointer_cast<ZataInt>(args[0]);
-    auto other = std::dynamic_pointer_cast<ZataInt>(args[1]);
+inline ZataObjectPtr int_sub(ZataObject* lhs, ZataObject* rhs) {
+    auto* self = zata_cast<ZataInt>(lhs);
+    auto* other = zata_cast<ZataInt>(rhs);
     if (!self || !other) return nullptr;
 
-    auto result = std::make_shared<ZataInt>();
-    result->val = self->val - other->val;
-    result->object_type = int_type;  // 补充结果的类型绑定
-    return result;
+    return create_int(self->val - other->val);
 }
 
 // 整数乘法
-inline ZataObjectPtr int_mul(const std::vector<ZataObjectPtr>& args) {
-    auto self = std::dynamic_pointer_cast<ZataInt>(args[0]);
-    auto other = std::dynamic_pointer_cast<ZataInt>(args[1]);
+inline ZataObjectPtr int_mul(ZataObject* lhs, ZataObject* rhs) {
+    auto* self = zata_cast<ZataInt>(lhs);
+    auto* other = zata_cast<ZataInt>(rhs);
     if (!self || !other) return nullptr;
 
-    auto result = std::make_shared<ZataInt>();
-    result->val = self->val * other->val;
-    result->object_type = int_type;  // 补充结果的类型绑定
-    return result;
+    return create_int(self->val * other->val);
 }
 
 // 整数除法
-inline ZataObjectPtr int_div(const std::vector<ZataObjectPtr>& args) {
-    auto self = std::dynamic_pointer_cast<ZataInt>(args[0]);
-    auto other = std::dynamic_pointer_cast<ZataInt>(args[1]);
+inline ZataObjectPtr int_div(ZataObject* lhs, ZataObject* rhs) {
+    auto* self = zata_cast<ZataInt>(lhs);
+    auto* other = zata_cast<ZataInt>(rhs);
     if (!self || !other || other->val == 0) return nullptr;
 
-    auto result = std::make_shared<ZataInt>();
-    result->val = self->val / other->val;
-    result->object_type = int_type;  // 补充结果的类型绑定
-    return result;
+    return create_int(self->val / other->val);
 }
 
 // 整数相等比较
-inline ZataObjectPtr int_eq(const std::vector<ZataObjectPtr>& args) {
-    auto self = std::dynamic_pointer_cast<ZataInt>(args[0]);
-    auto other = std::dynamic_pointer_cast<ZataInt>(args[1]);
+inline ZataObjectPtr int_eq(ZataObject* lhs, ZataObject* rhs) {
+    auto* self = zata_cast<ZataInt>(lhs);
+    auto* other = zata_cast<ZataInt>(rhs);
     if (!self || !other) return nullptr;
 
-    auto result = std::make_shared<ZataState>();
-    result->val = (self->val == other->val) ? 1 : 0;
-    // 假设ZataState有默认object_type绑定，若没有需补充：result->object_type = state_type;
-    return result;
+    return create_state((self->val == other->val) ? 1 : 0);
 }
 
 
-inline ZataObjectPtr int_gt(const std::vector<ZataObjectPtr>& args) {
-    auto self = std::dynamic_pointer_cast<ZataInt>(args[0]);
-    auto other = std::dynamic_pointer_cast<ZataInt>(args[1]);
+inline ZataObjectPtr int_gt(ZataObject* lhs, ZataObject* rhs) {
+    auto* self = zata_cast<ZataInt>(lhs);
+    auto* other = zata_cast<ZataInt>(rhs);
     if (!self || !other) return nullptr;
 
-    auto result = std::make_shared<ZataState>();
-    result->val = (self->val > other->val) ? 1 : 0;
-    return result;
+    return create_state((self->val > other->val) ? 1 : 0);
 }
 
 
-inline ZataObjectPtr int_lt(const std::vector<ZataObjectPtr>& args) {
-    auto self = std::dynamic_pointer_cast<ZataInt>(args[0]);
-    auto other = std::dynamic_pointer_cast<ZataInt>(args[1]);
+inline ZataObjectPtr int_lt(ZataObject* lhs, ZataObject* rhs) {
+    auto* self = zata_cast<ZataInt>(lhs);
+    auto* other = zata_cast<ZataInt>(rhs);
     if (!self || !other) return nullptr;
 
-    auto result = std::make_shared<ZataState>();
-    result->val = (self->val < other->val) ? 1 : 0;
-    return result;
+    return create_state((self->val < other->val) ? 1 : 0);
 }
 
 // 字符串加法（拼接）
-inline ZataObjectPtr str_add(const std::vector<ZataObjectPtr>& args) {
-    auto self = std::dynamic_pointer_cast<ZataString>(args[0]);
-    auto other = std::dynamic_pointer_cast<ZataString>(args[1]);
+inline ZataObjectPtr str_add(ZataObject* lhs, ZataObject* rhs) {
+    auto* self = zata_cast<ZataString>(lhs);
+    auto* other = zata_cast<ZataString>(rhs);
     if (!self || !other) return nullptr;
 
-    auto result = std::make_shared<ZataString>();
+    auto result = new ZataString();
     result->val = self->val + other->val;
-    result->object_type = str_type;  // 补充结果的类型绑定
     return result;
 }
 
 // 字符串相等比较
-inline ZataObjectPtr str_eq(const std::vector<ZataObjectPtr>& args) {
-    auto self = std::dynamic_pointer_cast<ZataString>(args[0]);
-    auto other = std::dynamic_pointer_cast<ZataString>(args[1]);
+inline ZataObjectPtr str_eq(ZataObject* lhs, ZataObject* rhs) {
+    auto* self = zata_cast<ZataString>(lhs);
+    auto* other = zata_cast<ZataString>(rhs);
     if (!self || !other) return nullptr;
 
-    auto result = std::make_shared<ZataState>();
-    result->val = (self->val == other->val) ? 1 : 0;
-    return result;
+    return create_state((self->val == other->val) ? 1 : 0);
 }
 
 // 长整数（ZataInt64）运算
-inline ZataObjectPtr int64_add(const std::vector<ZataObjectPtr>& args) {
-    auto self = std::dynamic_pointer_cast<ZataInt64>(args[0]);
-    auto other = std::dynamic_pointer_cast<ZataInt64>(args[1]);
+inline ZataObjectPtr int64_add(ZataObject* lhs, ZataObject* rhs) {
+    auto* self = zata_cast<ZataInt64>(lhs);
+    auto* other = zata_cast<ZataInt64>(rhs);
     if (!self || !other) return nullptr;
 
-    auto result = std::make_shared<ZataInt64>();
+    auto result = new ZataInt64();
     result->val = self->val + other->val;
-    result->object_type = int64_type;  // 补充结果的类型绑定
     return result;
 }
 
-inline ZataObjectPtr int64_sub(const std::vector<ZataObjectPtr>& args) {
-    auto self = std::dynamic_pointer_cast<ZataInt64>(args[0]);
-    auto other = std::dynamic_pointer_cast<ZataInt64>(args[1]);
+inline ZataObjectPtr int64_sub(ZataObject* lhs, ZataObject* rhs) {
+    auto* self = zata_cast<ZataInt64>(lhs);
+    auto* other = zata_cast<ZataInt64>(rhs);
     if (!self || !other) return nullptr;
 
-    auto result = std::make_shared<ZataInt64>();
+    auto result = new ZataInt64();
     result->val = self->val - other->val;
-    result->object_type = int64_type;  // 补充结果的类型绑定
     return result;
 }
 
-inline ZataObjectPtr int64_eq(const std::vector<ZataObjectPtr>& args) {
-    auto self = std::dynamic_pointer_cast<ZataInt64>(args[0]);
-    auto other = std::dynamic_pointer_cast<ZataInt64>(args[1]);
+inline ZataObjectPtr int64_eq(ZataObject* lhs, ZataObject* rhs) {
+    auto* self = zata_cast<ZataInt64>(lhs);
+    auto* other = zata_cast<ZataInt64>(rhs);
     if (!self || !other) return nullptr;
 
-    auto result = std::make_shared<ZataState>();
-    result->val = (self->val == other->val) ? 1 : 0;
-    return result;
+    return create_state((self->val == other->val) ? 1 : 0);
 }
 
-inline ZataObjectPtr int64_gt(const std::vector<ZataObjectPtr>& args) {
-    auto self = std::dynamic_pointer_cast<ZataInt64>(args[0]);
-    auto other = std::dynamic_pointer_cast<ZataInt64>(args[1]);
+inline ZataObjectPtr int64_gt(ZataObject* lhs, ZataObject* rhs) {
+    auto* self = zata_cast<ZataInt64>(lhs);
+    auto* other = zata_cast<ZataInt64>(rhs);
     if (!self || !other) return nullptr;
 
-    auto result = std::make_shared<ZataState>();
-    result->val = (self->val > other->val) ? 1 : 0;
-    return result;
+    return create_state((self->val > other->val) ? 1 : 0);
 }
 
-inline ZataObjectPtr int64_lt(const std::vector<ZataObjectPtr>& args) {
-    auto self = std::dynamic_pointer_cast<ZataInt64>(args[0]);
-    auto other = std::dynamic_pointer_cast<ZataInt64>(args[1]);
+inline ZataObjectPtr int64_lt(ZataObject* lhs, ZataObject* rhs) {
+    auto* self = zata_cast<ZataInt64>(lhs);
+    auto* other = zata_cast<ZataInt64>(rhs);
     if (!self || !other) return nullptr;
 
-    auto result = std::make_shared<ZataState>();
-    result->val = (self->val < other->val) ? 1 : 0;
-    return result;
+    return create_state((self->val < other->val) ? 1 : 0);
 }
 
 // 浮点数（ZataFloat）运算
-inline ZataObjectPtr float_add(const std::vector<ZataObjectPtr>& args) {
-    auto self = std::dynamic_pointer_cast<ZataFloat>(args[0]);
-    auto other = std::dynamic_pointer_cast<ZataFloat>(args[1]);
+inline ZataObjectPtr float_add(ZataObject* lhs, ZataObject* rhs) {
+    auto* self = zata_cast<ZataFloat>(lhs);
+    auto* other = zata_cast<ZataFloat>(rhs);
     if (!self || !other) return nullptr;
 
-    auto result = std::make_shared<ZataFloat>();
+    auto result = new ZataFloat();
     result->val = self->val + other->val;
-    result->object_type = float_type;  // 补充结果的类型绑定
     return result;
 }
 
-inline ZataObjectPtr float_sub(const std::vector<ZataObjectPtr>& args) {
-    auto self = std::dynamic_pointer_cast<ZataFloat>(args[0]);
-    auto other = std::dynamic_pointer_cast<ZataFloat>(args[1]);
+inline ZataObjectPtr float_sub(ZataObject* lhs, ZataObject* rhs) {
+    auto* self = zata_cast<ZataFloat>(lhs);
+    auto* other = zata_cast<ZataFloat>(rhs);
     if (!self || !other) return nullptr;
 
-    auto result = std::make_shared<ZataFloat>();
+    auto result = new ZataFloat();
     result->val = self->val - other->val;
-    result->object_type = float_type;  // 补充结果的类型绑定
     return result;
 }
 
-inline ZataObjectPtr float_eq(const std::vector<ZataObjectPtr>& args) {
-    auto self = std::dynamic_pointer_cast<ZataFloat>(args[0]);
-    auto other = std::dynamic_pointer_cast<ZataFloat>(args[1]);
+inline ZataObjectPtr float_eq(ZataObject* lhs, ZataObject* rhs) {
+    auto* self = zata_cast<ZataFloat>(lhs);
+    auto* other = zata_cast<ZataFloat>(rhs);
     if (!self || !other) return nullptr;
 
-    auto result = std::make_shared<ZataState>();
-    result->val = (self->val == other->val) ? 1 : 0;
-    return result;
+    return create_state((self->val == other->val) ? 1 : 0);
 }
 
 // float 大于：self > other
-inline ZataObjectPtr float_gt(const std::vector<ZataObjectPtr>& args) {
-    auto self = std::dynamic_pointer_cast<ZataFloat>(args[0]);
-    auto other = std::dynamic_pointer_cast<ZataFloat>(args[1]);
+inline ZataObjectPtr float_gt(ZataObject* lhs, ZataObject* rhs) {
+    auto* self = zata_cast<ZataFloat>(lhs);
+    auto* other = zata_cast<ZataFloat>(rhs);
     if (!self || !other) return nullptr;
 
-    auto result = std::make_shared<ZataState>();
-    result->val = (self->val > other->val) ? 1 : 0;
-    return result;
+    return create_state((self->val > other->val) ? 1 : 0);
 }
 
 // float 小于：self < other
-inline ZataObjectPtr float_lt(const std::vector<ZataObjectPtr>& args) {
-    auto self = std::dynamic_pointer_cast<ZataFloat>(args[0]);
-    auto other = std::dynamic_pointer_cast<ZataFloat>(args[1]);
+inline ZataObjectPtr float_lt(ZataObject* lhs, ZataObject* rhs) {
+    auto* self = zata_cast<ZataFloat>(lhs);
+    auto* other = zata_cast<ZataFloat>(rhs);
     if (!self || !other) return nullptr;
 
-    auto result = std::make_shared<ZataState>();
-    result->val = (self->val < other->val) ? 1 : 0;
-    return result;
+    return create_state((self->val < other->val) ? 1 : 0);
 }
 
 // 双精度浮点数（ZataFloat64）运算
-inline ZataObjectPtr float64_add(const std::vector<ZataObjectPtr>& args) {
-    auto self = std::dynamic_pointer_cast<ZataFloat64>(args[0]);
-    auto other = std::dynamic_pointer_cast<ZataFloat64>(args[1]);
+inline ZataObjectPtr float64_add(ZataObject* lhs, ZataObject* rhs) {
+    auto* self = zata_cast<ZataFloat64>(lhs);
+    auto* other = zata_cast<ZataFloat64>(rhs);
     if (!self || !other) return nullptr;
 
-    auto result = std::make_shared<ZataFloat64>();
+    auto result = new ZataFloat64();
     result->val = self->val + other->val;
-    result->object_type = float64_type;  // 补充结果的类型绑定
     return result;
 }
 
 // float64 大于：self > other
-inline ZataObjectPtr float64_gt(const std::vector<ZataObjectPtr>& args) {
-    auto self = std::dynamic_pointer_cast<ZataFloat64>(args[0]);
-    auto other = std::dynamic_pointer_cast<ZataFloat64>(args[1]);
+inline ZataObjectPtr float64_gt(ZataObject* lhs, ZataObject* rhs) {
+    auto* self = zata_cast<ZataFloat64>(lhs);
+    auto* other = zata_cast<ZataFloat64>(rhs);
     if (!self || !other) return nullptr;
 
-    auto result = std::make_shared<ZataState>();
-    result->val = (self->val > other->val) ? 1 : 0;
-    return result;
+    return create_state((self->val > other->val) ? 1 : 0);
 }
 
 // float64 小于：self < other
-inline ZataObjectPtr float64_lt(const std::vector<ZataObjectPtr>& args) {
-    auto self = std::dynamic_pointer_cast<ZataFloat64>(args[0]);
-    auto other = std::dynamic_pointer_cast<ZataFloat64>(args[1]);
+inline ZataObjectPtr float64_lt(ZataObject* lhs, ZataObject* rhs) {
+    auto* self = zata_cast<ZataFloat64>(lhs);
+    auto* other = zata_cast<ZataFloat64>(rhs);
     if (!self || !other) return nullptr;
 
-    auto result = std::make_shared<ZataState>();
-    result->val = (self->val < other->val) ? 1 : 0;
-    return result;
+    return create_state((self->val < other->val) ? 1 : 0);
 }
 
 // 字典（ZataDict）操作
-inline ZataObjectPtr dict_getitem(const std::vector<ZataObjectPtr>& args) {
-    auto self = std::dynamic_pointer_cast<ZataDict>(args[0]);
+inline ZataObjectPtr dict_getitem(ZataObject* container, const ZataObjectPtr& key) {
+    auto* self = zata_cast<ZataDict>(container);
     if (!self) return nullptr;
 
-    auto it = self->key_val.find(args[1]);
+    auto it = self->key_val.find(key);
     return (it != self->key_val.end()) ? it->second : nullptr;
 }
 
-inline ZataObjectPtr dict_setitem(const std::vector<ZataObjectPtr>& args) {
-    auto self = std::dynamic_pointer_cast<ZataDict>(args[0]);
+inline ZataObjectPtr dict_setitem(ZataObject* container, const ZataObjectPtr& key, const ZataObjectPtr& value) {
+    auto* self = zata_cast<ZataDict>(container);
     if (!self) return nullptr;
 
-    self->key_val[args[1]] = args[2];
-    auto result = std::make_shared<ZataState>();
-    result->val = 1;  // 成功状态
-    return result;
+    self->key_val[key] = value;
+    ZataHeap::instance().write_barrier(self, key);
+    ZataHeap::instance().write_barrier(self, value);
+    return create_state(1);  // 成功状态
 }
 
 // 元组（ZataTuple）操作
-inline ZataObjectPtr tuple_getitem(const std::vector<ZataObjectPtr>& args) {
-    auto self = std::dynamic_pointer_cast<ZataTuple>(args[0]);
-    auto index = std::dynamic_pointer_cast<ZataInt>(args[1]);
+inline ZataObjectPtr tuple_getitem(ZataObject* container, const ZataObjectPtr& key) {
+    auto* self = zata_cast<ZataTuple>(container);
+    auto* index = zata_cast<ZataInt>(key);
     if (!self || !index) return nullptr;
 
     int idx = index->val;
@@ -484,23 +530,22 @@ inline ZataObjectPtr tuple_getitem(const std::vector<ZataObjectPtr>& args) {
 }
 
 // 列表加法
-inline ZataObjectPtr list_add(const std::vector<ZataObjectPtr>& args) {
-    auto self = std::dynamic_pointer_cast<ZataList>(args[0]);
-    auto other = std::dynamic_pointer_cast<ZataList>(args[1]);
+inline ZataObjectPtr list_add(ZataObject* lhs, ZataObject* rhs) {
+    auto* self = zata_cast<ZataList>(lhs);
+    auto* other = zata_cast<ZataList>(rhs);
     if (!self || !other) return nullptr;
 
-    auto result = std::make_shared<ZataList>();
+    auto result = new ZataList();
     result->items = self->items;
     result->items.insert(result->items.end(), other->items.begin(), other->items.end());
     result->size = result->items.size();
-    result->object_type = list_type;  // 补充结果的类型绑定
     return result;
 }
 
 // 列表索引访问
-inline ZataObjectPtr list_getitem(const std::vector<ZataObjectPtr>& args) {
-    auto self = std::dynamic_pointer_cast<ZataList>(args[0]);
-    auto index = std::dynamic_pointer_cast<ZataInt>(args[1]);
+inline ZataObjectPtr list_getitem(ZataObject* container, const ZataObjectPtr& key) {
+    auto* self = zata_cast<ZataList>(container);
+    auto* index = zata_cast<ZataInt>(key);
     if (!self || !index) return nullptr;
 
     int idx = index->val;
@@ -510,60 +555,111 @@ inline ZataObjectPtr list_getitem(const std::vector<ZataObjectPtr>& args) {
     return self->items[idx];
 }
 
+// -------------------------- 立即数运算 --------------------------
+
+// 两个操作数是同类立即数时直接在ZataValue上计算, 不分配任何对象
+// 覆盖的运算与bind_*_type中绑定的魔术方法一致, 其余情况返回false, 由调用方走对象路径
+// pattern与B_CALC的操作数相同
+inline bool value_binary(const int pattern, const ZataValue& a, const ZataValue& b, ZataValue& out) {
+    if (a.is_int() && b.is_int()) {
+        // 按32位补码回绕, 与ZataInt的溢出行为一致且不触发未定义行为
+        const auto x = static_cast<uint32_t>(a.as_int());
+        const auto y = static_cast<uint32_t>(b.as_int());
+        switch (pattern) {
+            case 0: out = ZataValue::from_int(static_cast<int32_t>(x + y)); return true;
+            case 1: out = ZataValue::from_int(static_cast<int32_t>(x - y)); return true;
+            case 2: out = ZataValue::from_int(static_cast<int32_t>(x * y)); return true;
+            case 3:
+                if (b.as_int() == 0) return false;  // 除零交给int_div报错
+                if (b.as_int() == -1) {
+                    out = ZataValue::from_int(static_cast<int32_t>(0u - x));
+                    return true;
+                }
+                out = ZataValue::from_int(a.as_int() / b.as_int());
+                return true;
+            case 5: out = ZataValue::from_bool(a.as_int() == b.as_int()); return true;
+            case 7: out = ZataValue::from_bool(a.as_int() < b.as_int()); return true;
+            case 8: out = ZataValue::from_bool(a.as_int() > b.as_int()); return true;
+            default: return false;
+        }
+    }
+
+    if (a.is_float() && b.is_float()) {
+        const float x = a.as_float();
+        const float y = b.as_float();
+        switch (pattern) {
+            case 0: out = ZataValue::from_float(x + y); return true;
+            case 1: out = ZataValue::from_float(x - y); return true;
+            case 5: out = ZataValue::from_bool(x == y); return true;
+            case 7: out = ZataValue::from_bool(x < y); return true;
+            case 8: out = ZataValue::from_bool(x > y); return true;
+            default: return false;
+        }
+    }
+
+    if (a.is_double() && b.is_double()) {
+        const double x = a.as_double();
+        const double y = b.as_double();
+        switch (pattern) {
+            case 0: out = ZataValue::from_double(x + y); return true;
+            case 7: out = ZataValue::from_bool(x < y); return true;
+            case 8: out = ZataValue::from_bool(x > y); return true;
+            default: return false;
+        }
+    }
+
+    return false;
+}
+
 // -------------------------- 字符串转换（type_str）方法 --------------------------
 
 // 整数转字符串
-inline ZataObjectPtr int_str(const std::vector<ZataObjectPtr>& args) {
-    auto self = std::dynamic_pointer_cast<ZataInt>(args[0]);
+inline ZataObjectPtr int_str(ZataObject* obj) {
+    auto* self = zata_cast<ZataInt>(obj);
     if (!self) return nullptr;
 
-    auto result = std::make_shared<ZataString>();
+    auto result = new ZataString();
     result->val = std::to_string(self->val);
-    result->object_type = str_type;
     return result;
 }
 
 // 字符串转字符串（返回自身值）
-inline ZataObjectPtr str_str(const std::vector<ZataObjectPtr>& args) {
-    auto self = std::dynamic_pointer_cast<ZataString>(args[0]);
+inline ZataObjectPtr str_str(ZataObject* obj) {
+    auto* self = zata_cast<ZataString>(obj);
     if (!self) return nullptr;
 
-    auto result = std::make_shared<ZataString>();
+    auto result = new ZataString();
     result->val = self->val;
-    result->object_type = str_type;
     return result;
 }
 
 // 长整数（ZataInt64）转字符串
-inline ZataObjectPtr int64_str(const std::vector<ZataObjectPtr>& args) {
-    auto self = std::dynamic_pointer_cast<ZataInt64>(args[0]);
+inline ZataObjectPtr int64_str(ZataObject* obj) {
+    auto* self = zata_cast<ZataInt64>(obj);
     if (!self) return nullptr;
 
-    auto result = std::make_shared<ZataString>();
+    auto result = new ZataString();
     result->val = std::to_string(self->val);
-    result->object_type = str_type;
     return result;
 }
 
 // 浮点数（ZataFloat）转字符串
-inline ZataObjectPtr float_str(const std::vector<ZataObjectPtr>& args) {
-    auto self = std::dynamic_pointer_cast<ZataFloat>(args[0]);
+inline ZataObjectPtr float_str(ZataObject* obj) {
+    auto* self = zata_cast<ZataFloat>(obj);
     if (!self) return nullptr;
 
-    auto result = std::make_shared<ZataString>();
+    auto result = new ZataString();
     result->val = std::to_string(self->val);
-    result->object_type = str_type;
     return result;
 }
 
 // 双精度浮点数（ZataFloat64）转字符串
-inline ZataObjectPtr float64_str(const std::vector<ZataObjectPtr>& args) {
-    auto self = std::dynamic_pointer_cast<ZataFloat64>(args[0]);
+inline ZataObjectPtr float64_str(ZataObject* obj) {
+    auto* self = zata_cast<ZataFloat64>(obj);
     if (!self) return nullptr;
 
-    auto result = std::make_shared<ZataString>();
+    auto result = new ZataString();
     result->val = std::to_string(self->val);
-    result->object_type = str_type;
     return result;
 }
 
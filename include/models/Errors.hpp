@@ -2,7 +2,9 @@
 #define ZATA_ERRORS_H
 #include <iostream>
 #include <stack>
+#include <stdexcept>
 #include <string>
+#include <utility>
 
 #include "../vm_deps/CallFrame.hpp"
 
@@ -12,6 +14,14 @@ struct ZataError {
     int error_code = 0;
 };
 
+// 虚拟机运行时错误: zata_vm_error_thrower打印调用栈后抛出, 由启动虚拟机的地方处理
+// (命令行入口zvm以状态1退出, Python侧的execute_zmod转成ValueError)
+struct ZataVmError final : std::runtime_error {
+    ZataError error;
+    explicit ZataVmError(ZataError _error)
+        : std::runtime_error(_error.name + ": " + _error.message), error(std::move(_error)) {}
+};
+
 namespace Fore {
     const std::string RESET = "\033[0m";
 
@@ -34,7 +44,7 @@ namespace Fore {
     const std::string LIGHT_WHITE = "\033[97m";
 }
 
-inline void zata_vm_error_thrower(std::stack<CallFrame> current_call_stack,
+[[noreturn]] inline void zata_vm_error_thrower(std::stack<CallFrame> current_call_stack,
                                   const ZataError& error_class){
     std::cout << Fore::RED << "\n-- [ Trace Back ] --" << Fore::RESET << std::endl;
 
@@ -50,7 +60,7 @@ inline void zata_vm_error_thrower(std::stack<CallFrame> current_call_stack,
     std::cout << Fore::RED <<  error_class.name << ":" << error_class.message << " err_code=" << error_class.error_code << Fore::RESET << std::endl;
 
     std::cout << Fore::RED << "\n-- [ End ] --" << Fore::RESET  << std::endl;
-    exit(error_class.error_code);
-};
+    throw ZataVmError(error_class);
+}
 
 #endif // ZATA_ERRORS_H
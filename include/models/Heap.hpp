@@ -0,0 +1,750 @@
+#ifndef ZATA_HEAP_H
+#define ZATA_HEAP_H
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <iterator>
+#include <mutex>
+#include <new>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+struct ZataObject;
+class ZataValue;
+class ZataHeap;
+
+// 对象头中gc_flags的各个位
+namespace ZataGcFlag {
+    constexpr uint8_t MARKED = 0x01;      // 本次回收的标记阶段已经到达
+    constexpr uint8_t FREEING = 0x02;     // 正在被清扫阶段释放(析构时不必再从堆中摘除)
+    constexpr uint8_t OLD = 0x04;         // 已晋升到老年代
+    constexpr uint8_t REMEMBERED = 0x08;  // 在记忆集中
+    constexpr uint8_t ARENA = 0x10;       // 内存来自竞技场块(见ZataHeap::end_arena)
+    constexpr uint8_t IMMORTAL = 0x20;    // 不朽对象: 不在堆的对象表中, 永不回收, 标记时直接跳过
+    constexpr uint8_t PENDING = 0x40;     // 还在创建它的线程的登记缓冲里, 没有交给堆(见ZataHeap::track)
+    constexpr uint8_t UNTRACKED = 0x80;   // 竞技场里不需要析构的对象, 没有登记, 回收器只经由引用看到它(见ZataHeap::end_arena)
+}
+
+// 新生代累计分配多少字节后, 在下一个安全点做一次次要回收(只回收新生代); 运行时可用set_thresholds调整
+#ifndef ZVM_NURSERY_SIZE
+#define ZVM_NURSERY_SIZE (4 * 1024 * 1024)
+#endif
+
+// 老年代对象数达到阈值时做一次完整回收
+// 完整回收后阈值取 max(ZVM_GC_THRESHOLD, 存活对象数 * 2), 即老年代大约翻倍时再回收一次; 运行时可用set_thresholds调整
+#ifndef ZVM_GC_THRESHOLD
+#define ZVM_GC_THRESHOLD 100000
+#endif
+
+// 根的提供者(运行中的虚拟机): 回收时堆调用trace_roots, 由它对每个根调用heap.mark
+class ZataRootSource {
+public:
+    virtual void trace_roots(ZataHeap& heap) = 0;
+
+protected:
+    ~ZataRootSource() = default;
+};
+
+// 进程内唯一的堆. SLL与虚拟机各自编译了一份头文件, 加载SLL时把它的锚点指向这里,
+// 使两边创建的对象进入同一个堆(见utils/SLL_loader.hpp)
+extern "C" {
+inline ZataHeap* zata_heap_anchor = nullptr;
+}
+
+// 空块的公共来源: 各线程的对象池从这里成批领取空块, 自己的空块太多时成批交还
+// 只有领取/交还时加锁, 每次最多一个BATCH, 分配和释放对象本身不经过这里
+class ZataChunkSupply {
+public:
+    static constexpr size_t BATCH = 4;
+    static constexpr size_t MAX_CHUNKS = 64;  // 超过的空块直接还给系统
+
+    ZataChunkSupply() = default;
+    ZataChunkSupply(const ZataChunkSupply&) = delete;
+    ZataChunkSupply& operator=(const ZataChunkSupply&) = delete;
+
+    // 取出一批空块追加到out, 不够的部分新分配
+    void take(std::vector<void*>& out, const size_t chunk_size) {
+        size_t taken = 0;
+        {
+            std::lock_guard guard(this->lock);
+            while (taken < BATCH && !this->chunks.empty()) {
+                out.push_back(this->chunks.back());
+                this->chunks.pop_back();
+                taken += 1;
+            }
+        }
+        for (; taken < BATCH; ++taken) {
+            out.push_back(::operator new(chunk_size, std::align_val_t{chunk_size}));
+        }
+    }
+
+    // 交还chunks末尾的count个空块
+    void give(std::vector<void*>& chunks, size_t count, const size_t chunk_size) {
+        {
+            std::lock_guard guard(this->lock);
+            while (count && this->chunks.size() < MAX_CHUNKS) {
+                this->chunks.push_back(chunks.back());
+                chunks.pop_back();
+                count -= 1;
+            }
+        }
+        for (; count; --count) {
+            ::operator delete(chunks.back(), std::align_val_t{chunk_size});
+            chunks.pop_back();
+        }
+    }
+
+private:
+    std::mutex lock;
+    std::vector<void*> chunks;
+};
+
+// 小对象的分级对象池, 每个线程一个(由ZataHeap按线程分配, 见ZataHeap::ThreadCache)
+// 对象按大小(16字节一级)分到各自的级别, 每级使用自己的块(按CHUNK_SIZE对齐, 块头记录所属的池/级别/空闲链表/存活数),
+// 同一种对象因此聚在一起. 分配依次尝试: 当前块的空闲链表 -> 当前块的碰撞指针 -> 有空槽的块 -> 新块
+// 新块来自池里的空块, 用完时从ZataChunkSupply成批领取
+// 对象不移动(到处都是指向它的裸指针), 块内对象全部释放后整块回收复用
+// 超过MAX_OBJECT_SIZE的对象(内置对象都不超过)单独占一块按CHUNK_SIZE对齐的内存, 块头的级别为LARGE_CLASS
+// 因此任何对象都能由地址找到块头, 释放时不需要知道对象的大小
+// 竞技场模式(begin_arena ~ end_arena): 新对象只在专用的块里碰撞指针分配, 结束时没有存活对象的块整块交还(见ZataHeap::end_arena)
+// 线程: 只有所属线程分配和直接释放, 都不加锁; 别的线程释放的对象经release_remote压入无锁的远程释放栈,
+// 由所属线程在换块时(refill)取回. 计数器只由所属线程写, 其它线程读到的是近似值
+class ZataObjectPool {
+public:
+    static constexpr size_t CHUNK_SIZE = 64 * 1024;
+    static constexpr size_t GRANULE = 16;
+    static constexpr size_t MAX_OBJECT_SIZE = 512;  // 更大的对象单独分配一块
+    static constexpr size_t CLASS_COUNT = MAX_OBJECT_SIZE / GRANULE;
+    static constexpr size_t LARGE_CLASS = CLASS_COUNT;
+    static constexpr size_t MAX_SPARE_CHUNKS = 2 * ZataChunkSupply::BATCH;
+
+    struct ClassStats {
+        size_t object_size = 0;   // 本级的槽位大小
+        size_t chunks = 0;        // 正在使用的块数
+        size_t live_objects = 0;  // 尚未释放的对象数
+        size_t allocations = 0;   // 累计分配次数
+        size_t reused = 0;        // 其中复用空闲槽位的次数
+    };
+
+private:
+    struct FreeSlot {
+        FreeSlot* next;
+    };
+
+    struct Chunk {
+        ZataObjectPool* owner = nullptr;  // 所属的池, 单独分配的大对象为空
+        Chunk* prev = nullptr;       // 本级有空槽的块组成的双向链表
+        Chunk* next = nullptr;
+        FreeSlot* free = nullptr;    // 块内的空闲槽位
+        size_t live = 0;             // 块内还没释放的对象数
+        size_t size_class = 0;
+        bool listed = false;         // 是否在有空槽的块链表中
+        bool arena = false;          // 竞技场块, 竞技场结束前不进入有空槽的块链表
+    };
+
+    // 只由所属线程写(relaxed的读+写, 不是读改写), 其它线程可以随时读
+    struct Counters {
+        std::atomic<size_t> chunks{0};
+        std::atomic<size_t> live_objects{0};
+        std::atomic<size_t> allocations{0};
+        std::atomic<size_t> reused{0};
+    };
+
+    struct SizeClass {
+        Chunk* current = nullptr;    // 正在分配的块
+        char* top = nullptr;         // current中尚未分配过的区域
+        char* limit = nullptr;
+        Chunk* partial = nullptr;    // 有空槽的块(不含current)
+        Chunk* arena_current = nullptr;
+        char* arena_top = nullptr;
+        char* arena_limit = nullptr;
+        Counters stats;
+    };
+
+    static constexpr size_t HEADER_SIZE = (sizeof(Chunk) + GRANULE - 1) & ~(GRANULE - 1);
+
+    ZataChunkSupply& supply;
+    std::array<SizeClass, CLASS_COUNT> classes{};
+    std::vector<void*> spare;  // 已经清空, 留作复用的块
+    std::vector<Chunk*> arena_chunks;
+    bool arena = false;
+    std::atomic<FreeSlot*> remote{nullptr};  // 别的线程释放的槽位
+
+    static void bump(std::atomic<size_t>& counter, const size_t delta) {
+        counter.store(counter.load(std::memory_order_relaxed) + delta, std::memory_order_relaxed);
+    }
+
+    static void drop(std::atomic<size_t>& counter, const size_t delta) {
+        counter.store(counter.load(std::memory_order_relaxed) - delta, std::memory_order_relaxed);
+    }
+
+    static Chunk* chunk_of(void* ptr) {
+        return reinterpret_cast<Chunk*>(reinterpret_cast<uintptr_t>(ptr) & ~(CHUNK_SIZE - 1));
+    }
+
+    static void unlink(SizeClass& cls, Chunk* chunk) {
+        (chunk->prev ? chunk->prev->next : cls.partial) = chunk->next;
+        if (chunk->next) {
+            chunk->next->prev = chunk->prev;
+        }
+        chunk->prev = chunk->next = nullptr;
+        chunk->listed = false;
+    }
+
+    static void link(SizeClass& cls, Chunk* chunk) {
+        chunk->next = cls.partial;
+        if (cls.partial) {
+            cls.partial->prev = chunk;
+        }
+        cls.partial = chunk;
+        chunk->listed = true;
+    }
+
+    void recycle(SizeClass& cls, Chunk* chunk) {
+        drop(cls.stats.chunks, 1);
+        this->spare.push_back(chunk);
+        if (this->spare.size() > MAX_SPARE_CHUNKS) {
+            this->supply.give(this->spare, ZataChunkSupply::BATCH, CHUNK_SIZE);
+        }
+    }
+
+    Chunk* new_chunk(SizeClass& cls, const size_t index) {
+        if (this->spare.empty()) {
+            this->supply.take(this->spare, CHUNK_SIZE);
+        }
+        void* memory = this->spare.back();
+        this->spare.pop_back();
+        auto* chunk = new (memory) Chunk();
+        chunk->owner = this;
+        chunk->size_class = index;
+        bump(cls.stats.chunks, 1);
+        return chunk;
+    }
+
+    // current的空槽和未分配区域都用完了: 先取回别的线程释放的槽位, 再换成有空槽的块, 没有就换一个新块
+    // 离开的current留给其中的存活对象, 之后有对象释放时再进入有空槽的块链表
+    void refill(SizeClass& cls, const size_t index) {
+        this->drain_remote();
+        if (cls.current && cls.current->free) {
+            return;
+        }
+        if (Chunk* chunk = cls.partial) {
+            unlink(cls, chunk);
+            cls.current = chunk;
+            cls.top = cls.limit = nullptr;
+            return;
+        }
+        cls.current = this->new_chunk(cls, index);
+        cls.top = reinterpret_cast<char*>(cls.current) + HEADER_SIZE;
+        cls.limit = reinterpret_cast<char*>(cls.current) + CHUNK_SIZE;
+    }
+
+    void* allocate_arena(SizeClass& cls, const size_t index, const size_t slot_size) {
+        if (static_cast<size_t>(cls.arena_limit - cls.arena_top) < slot_size) {
+            cls.arena_current = this->new_chunk(cls, index);
+            cls.arena_current->arena = true;
+            this->arena_chunks.push_back(cls.arena_current);
+            cls.arena_top = reinterpret_cast<char*>(cls.arena_current) + HEADER_SIZE;
+            cls.arena_limit = reinterpret_cast<char*>(cls.arena_current) + CHUNK_SIZE;
+        }
+        void* ptr = cls.arena_top;
+        cls.arena_top += slot_size;
+        cls.arena_current->live += 1;
+        return ptr;
+    }
+
+public:
+    void* arena_last = nullptr;  // 最近一次从竞技场块分配的地址, 构造时据此给对象打上ARENA(见ZataHeap::track)
+
+    explicit ZataObjectPool(ZataChunkSupply& chunk_supply) : supply(chunk_supply) {}
+    ZataObjectPool(const ZataObjectPool&) = delete;
+    ZataObjectPool& operator=(const ZataObjectPool&) = delete;
+
+    // 对象所在块属于哪个池, 单独分配的大对象返回nullptr
+    static ZataObjectPool* owner_of(void* ptr) {
+        return chunk_of(ptr)->owner;
+    }
+
+    static void* allocate_large(const size_t size) {
+        void* memory = ::operator new(HEADER_SIZE + size, std::align_val_t{CHUNK_SIZE});
+        auto* chunk = new (memory) Chunk();
+        chunk->size_class = LARGE_CLASS;
+        return static_cast<char*>(memory) + HEADER_SIZE;
+    }
+
+    static void release_large(void* ptr) {
+        ::operator delete(chunk_of(ptr), std::align_val_t{CHUNK_SIZE});
+    }
+
+    void* allocate(const size_t size) {
+        if (size > MAX_OBJECT_SIZE) {
+            return allocate_large(size);
+        }
+        const size_t index = (size + GRANULE - 1) / GRANULE - 1;
+        const size_t slot_size = (index + 1) * GRANULE;
+        SizeClass& cls = this->classes[index];
+        bump(cls.stats.allocations, 1);
+        bump(cls.stats.live_objects, 1);
+        if (this->arena) {
+            void* ptr = this->allocate_arena(cls, index, slot_size);
+            this->arena_last = ptr;
+            return ptr;
+        }
+        for (;;) {
+            if (Chunk* chunk = cls.current) {
+                if (FreeSlot* slot = chunk->free) {
+                    chunk->free = slot->next;
+                    chunk->live += 1;
+                    bump(cls.stats.reused, 1);
+                    return slot;
+                }
+                if (static_cast<size_t>(cls.limit - cls.top) >= slot_size) {
+                    void* ptr = cls.top;
+                    cls.top += slot_size;
+                    chunk->live += 1;
+                    return ptr;
+                }
+            }
+            this->refill(cls, index);
+        }
+    }
+
+    // 只能由所属线程调用, 大对象用release_large
+    void release(void* ptr) {
+        Chunk* chunk = chunk_of(ptr);
+        SizeClass& cls = this->classes[chunk->size_class];
+        drop(cls.stats.live_objects, 1);
+        auto* slot = static_cast<FreeSlot*>(ptr);
+        slot->next = chunk->free;
+        chunk->free = slot;
+        chunk->live -= 1;
+        if (chunk == cls.current || chunk->arena) {
+            return;
+        }
+        if (chunk->live == 0) {
+            if (chunk->listed) {
+                unlink(cls, chunk);
+            }
+            this->recycle(cls, chunk);
+        } else if (!chunk->listed) {
+            link(cls, chunk);
+        }
+    }
+
+    // 别的线程释放本池的对象: 压入远程释放栈(多个生产者, 只有所属线程整体取走, 因此没有ABA问题)
+    void release_remote(void* ptr) {
+        auto* slot = static_cast<FreeSlot*>(ptr);
+        FreeSlot* head = this->remote.load(std::memory_order_relaxed);
+        do {
+            slot->next = head;
+        } while (!this->remote.compare_exchange_weak(head, slot, std::memory_order_release, std::memory_order_relaxed));
+    }
+
+    // 取回远程释放的槽位, 由所属线程(或者接管了无主池的线程)调用
+    void drain_remote() {
+        FreeSlot* slot = this->remote.exchange(nullptr, std::memory_order_acquire);
+        while (slot) {
+            FreeSlot* next = slot->next;
+            this->release(slot);
+            slot = next;
+        }
+    }
+
+    [[nodiscard]] bool in_arena() const {
+        return this->arena;
+    }
+
+    void begin_arena() {
+        this->arena = true;
+    }
+
+    // 竞技场结束. survivors是竞技场块里仍然存活的对象(按地址排序), 其余对象都已死去(需要析构的已经析构)
+    // 没有存活对象的块整块回收, 不看里面的对象; 有的块重建空闲链表(除存活对象外的所有槽位), 变成普通的块
+    // 返回死去的对象数
+    size_t end_arena(const std::vector<void*>& survivors) {
+        this->drain_remote();
+        std::sort(this->arena_chunks.begin(), this->arena_chunks.end());
+        size_t dead = 0;
+        auto survivor = survivors.begin();
+        for (auto* chunk : this->arena_chunks) {
+            SizeClass& cls = this->classes[chunk->size_class];
+            size_t kept = 0;
+            chunk->free = nullptr;
+            if (survivor != survivors.end() && chunk_of(*survivor) == chunk) {
+                const size_t slot_size = (chunk->size_class + 1) * GRANULE;
+                char* end = reinterpret_cast<char*>(chunk) + CHUNK_SIZE;
+                FreeSlot** tail = &chunk->free;
+                for (char* slot = reinterpret_cast<char*>(chunk) + HEADER_SIZE; slot + slot_size <= end; slot += slot_size) {
+                    if (survivor != survivors.end() && *survivor == slot) {
+                        ++survivor;
+                        ++kept;
+                        continue;
+                    }
+                    *tail = reinterpret_cast<FreeSlot*>(slot);
+                    tail = &(*tail)->next;
+                }
+                *tail = nullptr;
+            }
+            dead += chunk->live - kept;
+            drop(cls.stats.live_objects, chunk->live - kept);
+            chunk->live = kept;
+            chunk->arena = false;
+            if (!kept) {
+                this->recycle(cls, chunk);
+            } else if (chunk->free) {
+                link(cls, chunk);
+            }
+        }
+        this->arena_chunks.clear();
+        for (auto& cls : this->classes) {
+            cls.arena_current = nullptr;
+            cls.arena_top = cls.arena_limit = nullptr;
+        }
+        this->arena = false;
+        this->arena_last = nullptr;
+        return dead;
+    }
+
+    // 把各级别的统计累加到result(下标为级别)
+    void add_stats(std::array<ClassStats, CLASS_COUNT>& result) const {
+        for (size_t i = 0; i < CLASS_COUNT; ++i) {
+            const Counters& stats = this->classes[i].stats;
+            result[i].chunks += stats.chunks.load(std::memory_order_relaxed);
+            result[i].live_objects += stats.live_objects.load(std::memory_order_relaxed);
+            result[i].allocations += stats.allocations.load(std::memory_order_relaxed);
+            result[i].reused += stats.reused.load(std::memory_order_relaxed);
+        }
+    }
+};
+
+// 精确的标记-清扫回收器
+// 所有ZataObject在构造时登记到堆中, 对象之间用裸指针相互引用, 只有回收器会释放对象
+// 根: 被ZataHandle固定的对象(Python侧持有的对象都经由它) + 各虚拟机的操作数栈/帧/全局变量/常量池
+// 只在安全点回收(虚拟机的向后跳转/CALL/run入口, 或显式调用collect), 两个安全点之间C++局部变量里的裸指针总是安全的
+// 分代: 新对象在新生代, 熬过一次次要回收就晋升到老年代(只改标志位, 对象的内存来自ZataObjectPool)
+// 次要回收只追踪新生代, 老年代到新生代的引用靠记忆集: 改写老年代对象的地方调用write_barrier,
+// 被固定的老年代对象(Python侧随时可能改写它)也一直留在记忆集里
+// 线程: 每个线程从自己的对象池分配内存, 不加锁; 释放别的线程的对象时交给对象所属的池(远程释放, 同样不加锁)
+// 新对象先登记在本线程的缓冲里(带PENDING), 每TRACK_BATCH个加一次锁交给堆(publish), 回收开始时并入新生代(merge_tracked)
+// 还在别的线程缓冲里的对象不会被清扫; 回收时被标记到的直接算作老年代, 并入时进入老年代
+// 回收, 竞技场和写屏障仍假定同一时刻只有一个修改者: 调用方需持有GIL(execute_zmod执行期间不会释放GIL)
+class ZataHeap {
+public:
+    struct Stats {
+        size_t collections = 0;        // 已完成的完整回收次数
+        size_t minor_collections = 0;  // 已完成的次要回收次数
+        size_t allocated_objects = 0;  // 累计登记的对象数
+        size_t freed_objects = 0;      // 累计释放的对象数
+        size_t promoted_objects = 0;   // 累计晋升到老年代的对象数
+        size_t arena_releases = 0;     // 已结束的竞技场次数
+        size_t live_objects = 0;       // 当前登记在堆中的对象数
+        size_t young_objects = 0;      // 其中在新生代的对象数
+        size_t threshold = 0;          // 老年代对象数达到多少时做下一次完整回收
+    };
+
+private:
+    std::vector<ZataObject*> young;            // 新生代对象
+    std::vector<ZataObject*> objects;          // 老年代对象
+    std::vector<ZataObject*> remembered;       // 可能引用新生代对象的老年代对象
+    std::vector<ZataObject*> gray;             // 标记阶段的工作表, 处理完后就是本次存活的对象
+    std::vector<ZataRootSource*> root_sources;
+    ZataChunkSupply chunk_supply;
+    mutable std::mutex pools_lock;             // 保护pools/abandoned_pools
+    std::vector<ZataObjectPool*> pools;        // 所有线程的对象池
+    std::vector<ZataObjectPool*> abandoned_pools; // 线程退出后留下的池, 由之后的线程接管
+    ZataObjectPool* arena_pool = nullptr;      // 竞技场所在线程的池, 竞技场由同一个线程开始和结束
+    std::vector<void*> arena_survivors;        // end_arena的临时表, 留着容量复用
+    std::mutex published_lock;                 // 保护published, allocated_total
+    std::vector<ZataObject*> published;        // 各线程交来的新对象, 下次回收前并入新生代
+    std::vector<ZataObject*> merging;          // merge_tracked的临时表, 留着容量复用
+    uint8_t skip_flags = 0;                    // 标记时跳过带这些标志的对象, 次要回收时为OLD
+    std::atomic<size_t> young_bytes{0};        // 各线程每分配YOUNG_BYTES_BATCH字节累加一次
+    size_t arena_depth = 0;
+    size_t nursery_size = ZVM_NURSERY_SIZE;    // 触发次要回收的新生代字节数
+    size_t min_threshold = ZVM_GC_THRESHOLD;   // 完整回收阈值的下限
+    size_t threshold = ZVM_GC_THRESHOLD;
+    size_t collections = 0;
+    size_t minor_collections = 0;
+    size_t allocated_total = 0;
+    size_t freed_total = 0;
+    size_t promoted_total = 0;
+    size_t arena_releases = 0;
+    std::atomic<uint64_t> next_identity_block{1};  // 0保留给"未分配"; 64位, 用尽时报错而不是回绕
+
+    // 以下定义在models/Trace.hpp
+    inline void mark_young();
+    inline void promote(ZataObject* obj);
+    inline void finish_young(size_t freed);
+    inline void keep_pinned_remembered();
+
+    static void erase_last(std::vector<ZataObject*>& list, const ZataObject* obj) {
+        const auto it = std::find(list.rbegin(), list.rend(), obj);
+        if (it != list.rend()) {
+            list.erase(std::next(it).base());
+        }
+    }
+
+    // 每个线程的分配状态. 线程退出时交出缓冲里的对象, 池交还堆(池里的对象可能还活着, 池留给之后的线程接管)
+    struct ThreadCache {
+        ZataObjectPool* pool = nullptr;
+        std::vector<ZataObject*> tracked;  // 本线程新登记, 还没有交给堆的对象
+        size_t pending_bytes = 0;          // 还没有计入young_bytes的分配字节数
+        ~ThreadCache() {
+            ZataHeap& heap = ZataHeap::instance();
+            heap.publish(*this);
+            if (this->pool) {
+                heap.abandon_pool(this->pool);
+            }
+        }
+    };
+
+    static ThreadCache& local_cache() {
+        thread_local ThreadCache cache;
+        return cache;
+    }
+
+    // SLL编译了自己的一份头文件, 也就有自己的thread_local; 一律经由创建堆的那一份取,
+    // 同一线程上虚拟机和SLL创建的对象因此进入同一个池和同一个缓冲
+    ThreadCache& (*const thread_cache)() = &ZataHeap::local_cache;
+
+    ZataObjectPool* adopt_pool() {
+        std::lock_guard guard(this->pools_lock);
+        if (!this->abandoned_pools.empty()) {
+            ZataObjectPool* pool = this->abandoned_pools.back();
+            this->abandoned_pools.pop_back();
+            return pool;
+        }
+        auto* pool = new ZataObjectPool(this->chunk_supply);
+        this->pools.push_back(pool);
+        return pool;
+    }
+
+    void abandon_pool(ZataObjectPool* pool) {
+        std::lock_guard guard(this->pools_lock);
+        this->abandoned_pools.push_back(pool);
+    }
+
+    // 当前线程的对象池, create为false时可能返回nullptr(这个线程还没有分配过对象)
+    ZataObjectPool* thread_pool(const bool create) {
+        ThreadCache& cache = this->thread_cache();
+        if (!cache.pool && create) {
+            cache.pool = this->adopt_pool();
+        }
+        return cache.pool;
+    }
+
+    // 把缓冲里的对象交给堆, 清除它们的PENDING(定义在models/Objects.hpp)
+    inline void publish(ThreadCache& cache);
+
+    // 回收前调用: 交出本线程的缓冲, 再把各线程交来的对象并入新生代(回收时已被标记过的进入老年代)
+    inline void merge_tracked();
+
+    // 放进本线程的登记缓冲(定义在models/Objects.hpp)
+    inline void enlist(ThreadCache& cache, ZataObject* obj);
+
+    // 无主的池没有线程取回别的线程释放的槽位, 回收结束时由回收的线程代劳(定义在models/Trace.hpp)
+    inline void drain_abandoned_pools();
+
+    ZataHeap() = default;
+
+public:
+    static constexpr size_t YOUNG_BYTES_BATCH = 4096;
+    static constexpr size_t TRACK_BATCH = 256;  // 登记缓冲攒够这么多对象就交给堆
+
+    ZataHeap(const ZataHeap&) = delete;
+    ZataHeap& operator=(const ZataHeap&) = delete;
+
+    // 有意不析构: 退出时仍可能有Python侧持有的对象
+    static ZataHeap& instance() {
+        if (!zata_heap_anchor) {
+            zata_heap_anchor = new ZataHeap();
+        }
+        return *zata_heap_anchor;
+    }
+
+    // 由ZataObject的operator new/delete调用, 都不加锁
+    void* allocate(const size_t size) {
+        ThreadCache& cache = this->thread_cache();
+        if (!cache.pool) {
+            cache.pool = this->adopt_pool();
+        }
+        cache.pending_bytes += size;
+        if (cache.pending_bytes >= YOUNG_BYTES_BATCH) {
+            this->young_bytes.fetch_add(cache.pending_bytes, std::memory_order_relaxed);
+            cache.pending_bytes = 0;
+        }
+        return cache.pool->allocate(size);
+    }
+
+    void release(void* ptr) {
+        ZataObjectPool* owner = ZataObjectPool::owner_of(ptr);
+        if (!owner) {
+            ZataObjectPool::release_large(ptr);
+        } else if (owner == this->thread_pool(false)) {
+            owner->release(ptr);
+        } else {
+            owner->release_remote(ptr);
+        }
+    }
+
+    // 当前线程的池, 竞技场和对象登记用它判断对象是否来自竞技场块
+    ZataObjectPool* current_pool() {
+        return this->thread_pool(false);
+    }
+
+    // 由ZataObject的构造函数调用, 定义在models/Objects.hpp
+    inline void track(ZataObject* obj);
+
+    // 对象不经过回收器被销毁时(例如构造中途抛出异常)从堆中摘除, 线性查找, 只用于这类少见情况
+    void forget(const ZataObject* obj) {
+        erase_last(this->thread_cache().tracked, obj);
+        {
+            std::lock_guard guard(this->published_lock);
+            erase_last(this->published, obj);
+        }
+        erase_last(this->young, obj);
+        erase_last(this->objects, obj);
+        erase_last(this->remembered, obj);
+    }
+
+    void add_root_source(ZataRootSource* source) {
+        this->root_sources.push_back(source);
+    }
+
+    void remove_root_source(const ZataRootSource* source) {
+        std::erase(this->root_sources, source);
+    }
+
+    // 竞技场期间不回收, 由end_arena一次处理
+    [[nodiscard]] bool collect_due() const {
+        return this->young_bytes.load(std::memory_order_relaxed) >= this->nursery_size && !this->arena_depth;
+    }
+
+    // 调整回收时机: 新生代字节数 / 完整回收阈值的下限, 传0表示保持不变
+    // 新的下限立即生效(当前阈值不会低于它), 在下一个安全点按新的设置判断
+    void set_thresholds(const size_t nursery_bytes, const size_t min_objects) {
+        if (nursery_bytes) {
+            this->nursery_size = nursery_bytes;
+        }
+        if (min_objects) {
+            this->min_threshold = min_objects;
+            this->threshold = std::max(this->min_threshold, this->objects.size() * 2);
+        }
+    }
+
+    [[nodiscard]] size_t nursery_threshold() const {
+        return this->nursery_size;
+    }
+
+    [[nodiscard]] size_t object_threshold() const {
+        return this->min_threshold;
+    }
+
+    // 先并入各线程交来的对象; 还在别的线程缓冲里的对象不计入live_objects
+    [[nodiscard]] Stats stats() {
+        this->merge_tracked();
+        return Stats{
+            .collections = this->collections,
+            .minor_collections = this->minor_collections,
+            .allocated_objects = this->allocated_total,
+            .freed_objects = this->freed_total,
+            .promoted_objects = this->promoted_total,
+            .arena_releases = this->arena_releases,
+            .live_objects = this->young.size() + this->objects.size(),
+            .young_objects = this->young.size(),
+            .threshold = this->threshold,
+        };
+    }
+
+    // 所有线程的池合计, 只列出分配过对象的级别
+    [[nodiscard]] std::vector<ZataObjectPool::ClassStats> pool_stats() const {
+        std::array<ZataObjectPool::ClassStats, ZataObjectPool::CLASS_COUNT> total{};
+        {
+            std::lock_guard guard(this->pools_lock);
+            for (const auto* pool : this->pools) {
+                pool->add_stats(total);
+            }
+        }
+        std::vector<ZataObjectPool::ClassStats> result;
+        for (size_t i = 0; i < total.size(); ++i) {
+            if (total[i].allocations) {
+                total[i].object_size = (i + 1) * ZataObjectPool::GRANULE;
+                result.push_back(total[i]);
+            }
+        }
+        return result;
+    }
+
+    // 领取一段连续的对象identity, 返回第一个; 各线程(以及各SLL)从这里领取, 互不重复
+    // identity只有32位(在对象头里), 用尽后抛出overflow_error, 不会回绕到已经发出去的值
+    uint32_t claim_identities(const uint32_t count) {
+        const uint64_t first = this->next_identity_block.fetch_add(count, std::memory_order_relaxed);
+        if (first + count > static_cast<uint64_t>(UINT32_MAX) + 1) {
+            throw std::overflow_error("object identities exhausted");
+        }
+        return static_cast<uint32_t>(first);
+    }
+
+    // 以下需要完整的对象定义: mark/pin/unpin/remember/write_barrier在models/Objects.hpp,
+    // collect/collect_young/safe_point在models/Trace.hpp
+    inline void mark(ZataObject* obj);
+    inline void mark(const ZataValue& value);
+    inline void remember(ZataObject* obj);
+    inline void make_immortal(ZataObject* obj);
+    inline void write_barrier(ZataObject* owner, const ZataObject* target);
+    inline void write_barrier(ZataObject* owner, const ZataValue& value);
+    inline void write_barrier(ZataObject* owner);
+    inline size_t collect();
+    inline size_t collect_young();
+    inline void safe_point();
+    inline void begin_arena();
+    inline size_t end_arena();
+
+    static inline void pin(ZataObject* obj);
+    static inline void unpin(ZataObject* obj);
+};
+
+// 固定对象的句柄: 存活期间对象(及其可达的对象)不会被回收
+// pybind的holder类型, 也用于指令内部跨越重入exec(可能回收)保存的中间对象
+template <typename T>
+class ZataHandle {
+private:
+    T* ptr = nullptr;
+
+public:
+    ZataHandle() = default;
+
+    explicit ZataHandle(T* _ptr) : ptr(_ptr) {
+        if (this->ptr) {
+            ZataHeap::pin(this->ptr);
+        }
+    }
+
+    ZataHandle(const ZataHandle& other) : ZataHandle(other.ptr) {}
+
+    ZataHandle(ZataHandle&& other) noexcept : ptr(other.ptr) {
+        other.ptr = nullptr;
+    }
+
+    ZataHandle& operator=(ZataHandle other) noexcept {
+        std::swap(this->ptr, other.ptr);
+        return *this;
+    }
+
+    ~ZataHandle() {
+        if (this->ptr) {
+            ZataHeap::unpin(this->ptr);
+        }
+    }
+
+    [[nodiscard]] T* get() const { return this->ptr; }
+    T* operator->() const { return this->ptr; }
+    T& operator*() const { return *this->ptr; }
+    explicit operator bool() const { return this->ptr != nullptr; }
+};
+
+#endif // ZATA_HEAP_H
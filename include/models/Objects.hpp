@@ -1,8 +1,9 @@
 #ifndef ZATA_OBJECTS_H
 #define ZATA_OBJECTS_H
 
-#include <any>
+#include <array>
 #include <atomic>
+#include <cstdint>
 #include <functional>
 #include <unordered_map>
 #include <string>
@@ -10,199 +11,641 @@
 #include <utility>
 #include <memory>
 
-inline size_t get_uuid() {
-    static std::atomic_size_t uuid_counter(0);
-    return uuid_counter++;
+#include "models/Heap.hpp"
+#include "models/Shape.hpp"
+#include "models/ZataValue.hpp"
+
+// 对象的identity只在第一次取object_id时分配: 每个线程一次从堆领取一段, 段内在本线程递增,
+// 创建对象本身不碰任何全局计数器
+constexpr uint32_t ZATA_IDENTITY_BLOCK = 4096;
+
+inline uint32_t zata_next_identity() {
+    thread_local uint64_t next = 0;
+    thread_local uint64_t limit = 0;
+    if (next == limit) {
+        next = ZataHeap::instance().claim_identities(ZATA_IDENTITY_BLOCK);
+        limit = next + ZATA_IDENTITY_BLOCK;
+    }
+    return static_cast<uint32_t>(next++);
 }
 
 struct ZataMetaType;
 struct ZataBuiltinsType;
 struct ZataUserType;
 
-struct ZataObject;
-using ZataObjectPtr = std::shared_ptr<ZataObject>;
+// 对象种类, 存在对象头里, 用来代替RTTI做类型判断
+// 内置数据类型(BuiltinsClass ~ State)和元类型(MetaType ~ UserType)各自连续排列, 便于按范围判断基类
+enum class ZataKind : uint8_t {
+    Object,
+    CodeObject,
+    Module,
+    Function,
+    Class,
+    Instance,
+
+    MetaType,
+    BuiltinsType,
+    UserType,
+
+    BuiltinsClass,
+    String,
+    Int,
+    Int64,
+    InfInt,
+    Float,
+    Float64,
+    Dec,
+    List,
+    Dict,
+    Tuple,
+    Record,
+    State,
+};
+
+constexpr size_t ZATA_KIND_COUNT = static_cast<size_t>(ZataKind::State) + 1;
+
+// 析构时有事要做(成员里有容器/字符串等)的种类. 其余种类的对象在竞技场里不登记, 死了也不析构, 随块一起释放
+// 给下面这些种类加上这样的成员时, 必须把它从列表中去掉
+constexpr bool zata_kind_needs_destructor(const ZataKind kind) {
+    switch (kind) {
+        case ZataKind::Int: case ZataKind::Int64: case ZataKind::Float: case ZataKind::Float64:
+        case ZataKind::State:
+            return false;
+        default:
+            return true;
+    }
+}
 
 // 基类
+// 对象一律分配在堆上(new或Python侧构造), 构造时登记到ZataHeap, 由回收器释放
+// 内存来自ZataHeap::allocate(分级对象池, 见ZataObjectPool)
+// 对象头共16字节: 虚表指针 + kind + gc_flags + gc_pins + identity
+// 内置数据对象的类型由kind决定(见builtins_types), 头里不存类型指针; identity在第一次取object_id时才分配
 struct ZataObject {
-    std::shared_ptr<ZataMetaType> object_type;
-    const size_t object_id;
-    ZataObject() : object_type(nullptr), object_id(get_uuid()) {}
-    virtual ~ZataObject() = default;
+    const ZataKind kind;
+    uint8_t gc_flags = 0;   // ZataGcFlag
+    uint16_t gc_pins = 0;   // ZataHandle的固定计数, 非0时是回收的根; 达到上限后不再变化(永久固定)
+    mutable uint32_t identity = 0;  // 0表示还没有分配
+    explicit ZataObject(const ZataKind _kind = ZataKind::Object)
+        : kind(_kind) {
+        ZataHeap::instance().track(this);
+    }
+    virtual ~ZataObject() {
+        if (!(this->gc_flags & (ZataGcFlag::FREEING | ZataGcFlag::UNTRACKED))) {
+            ZataHeap::instance().forget(this);
+        }
+    }
 
 public:
-    ZataObject(const ZataObject&) = default;
+    // 副本与原对象共用同一个identity(两者==)
+    ZataObject(const ZataObject& other)
+        : kind(other.kind), identity(static_cast<uint32_t>(other.object_id())) {
+        ZataHeap::instance().track(this);
+    }
+    static void* operator new(const size_t size) {
+        return ZataHeap::instance().allocate(size);
+    }
+    // 不带大小的版本: 与operator new(size_t)配对, 对象池由地址就能找回分配它的块
+    static void operator delete(void* ptr) {
+        ZataHeap::instance().release(ptr);
+    }
+    // 两个线程同时第一次取id时只有先写入的那个生效
+    [[nodiscard]] size_t object_id() const {
+        std::atomic_ref<uint32_t> identity_ref(this->identity);
+        uint32_t id = identity_ref.load(std::memory_order_relaxed);
+        if (!id) {
+            const uint32_t claimed = zata_next_identity();
+            if (identity_ref.compare_exchange_strong(id, claimed, std::memory_order_relaxed)) {
+                id = claimed;
+            }
+        }
+        return id;
+    }
+    // 同一个对象, 或者互为拷贝(拷贝时双方的identity都已分配)
     bool operator==(const ZataObjectPtr& other) const {
-        if (this->object_id == other->object_id) {
-            return true;
-        }return false;
+        return this == other || (this->identity && this->identity == other->identity);
     }
 };
 
+static_assert(sizeof(ZataObject) == 16, "ZataObject header must stay 16 bytes");
+
+// 登记只写本线程的缓冲; 缓冲满了先整批交给堆, 刚登记的对象因此总在缓冲末尾(make_immortal依赖这一点)
+// 竞技场里不需要析构的对象不登记(UNTRACKED), 存活与否由end_arena经标记得知
+inline void ZataHeap::track(ZataObject* obj) {
+    ThreadCache& cache = this->thread_cache();
+    if (cache.pool && cache.pool->arena_last == static_cast<void*>(obj)) {
+        obj->gc_flags |= ZataGcFlag::ARENA;
+        cache.pool->arena_last = nullptr;
+        if (!zata_kind_needs_destructor(obj->kind)) {
+            obj->gc_flags |= ZataGcFlag::UNTRACKED;
+            return;
+        }
+    }
+    this->enlist(cache, obj);
+}
+
+inline void ZataHeap::enlist(ThreadCache& cache, ZataObject* obj) {
+    if (cache.tracked.size() >= TRACK_BATCH) {
+        this->publish(cache);
+    }
+    obj->gc_flags |= ZataGcFlag::PENDING;
+    cache.tracked.push_back(obj);
+}
+
+inline void ZataHeap::publish(ThreadCache& cache) {
+    if (cache.tracked.empty()) {
+        return;
+    }
+    for (auto* obj : cache.tracked) {
+        obj->gc_flags &= ~ZataGcFlag::PENDING;
+    }
+    {
+        std::lock_guard guard(this->published_lock);
+        this->published.insert(this->published.end(), cache.tracked.begin(), cache.tracked.end());
+    }
+    cache.tracked.clear();
+}
+
+inline void ZataHeap::merge_tracked() {
+    this->publish(this->thread_cache());
+    {
+        std::lock_guard guard(this->published_lock);
+        this->merging.swap(this->published);
+    }
+    for (auto* obj : this->merging) {
+        if (obj->gc_flags & ZataGcFlag::OLD) {
+            this->objects.push_back(obj);
+            if (obj->gc_pins) {
+                this->remember(obj);
+            }
+        } else {
+            this->young.push_back(obj);
+        }
+    }
+    this->allocated_total += this->merging.size();
+    this->merging.clear();
+}
+
+inline void ZataHeap::mark(ZataObject* obj) {
+    if (obj && !(obj->gc_flags & (ZataGcFlag::MARKED | ZataGcFlag::IMMORTAL | this->skip_flags))) {
+        obj->gc_flags |= ZataGcFlag::MARKED;
+        this->gray.push_back(obj);
+    }
+}
+
+inline void ZataHeap::mark(const ZataValue& value) {
+    this->mark(value.as_object());
+}
+
+// 把刚创建的对象变成不朽对象: 从对象表中摘除, 之后回收器看不到它
+// 只用于不可变且不引用可回收对象的对象(内置类型, 状态值, 小整数等)
+inline void ZataHeap::make_immortal(ZataObject* obj) {
+    if (obj->gc_flags & ZataGcFlag::PENDING) {
+        std::vector<ZataObject*>& tracked = this->thread_cache().tracked;
+        if (!tracked.empty() && tracked.back() == obj) {
+            tracked.pop_back();
+        } else {
+            erase_last(tracked, obj);
+        }
+    } else {
+        this->forget(obj);
+    }
+    obj->gc_flags = (obj->gc_flags & ~ZataGcFlag::PENDING) | ZataGcFlag::OLD | ZataGcFlag::IMMORTAL;
+}
+
+inline void ZataHeap::remember(ZataObject* obj) {
+    if (!(obj->gc_flags & ZataGcFlag::REMEMBERED)) {
+        obj->gc_flags |= ZataGcFlag::REMEMBERED;
+        this->remembered.push_back(obj);
+    }
+}
+
+// 写屏障: owner里存入target之后调用, 老年代对象引用了新生代对象时记入记忆集
+inline void ZataHeap::write_barrier(ZataObject* owner, const ZataObject* target) {
+    if ((owner->gc_flags & ZataGcFlag::OLD) && target && !(target->gc_flags & ZataGcFlag::OLD)) {
+        this->remember(owner);
+    }
+}
+
+inline void ZataHeap::write_barrier(ZataObject* owner, const ZataValue& value) {
+    this->write_barrier(owner, value.as_object());
+}
+
+// 不知道owner里存入了什么(例如交给原生函数改写过)时, 老年代的owner一律记入记忆集
+inline void ZataHeap::write_barrier(ZataObject* owner) {
+    if (owner && (owner->gc_flags & ZataGcFlag::OLD)) {
+        this->remember(owner);
+    }
+}
+
+// 被固定的对象可能被Python侧改写(不经过写屏障), 老年代的固定对象因此记入记忆集
+// 固定对象是回收的根, 回收器只在新生代和记忆集里找它: 还在登记缓冲里的对象先交给堆;
+// 交出本线程的缓冲后仍是PENDING的(在别的线程的缓冲里)直接算作老年代, 靠记忆集充当根
+// 没有登记的竞技场对象这时补上登记
+inline void ZataHeap::pin(ZataObject* obj) {
+    if (obj->gc_pins != UINT16_MAX) {
+        obj->gc_pins += 1;
+    }
+    ZataHeap& heap = ZataHeap::instance();
+    if (obj->gc_flags & ZataGcFlag::UNTRACKED) {
+        obj->gc_flags &= ~ZataGcFlag::UNTRACKED;
+        heap.enlist(heap.thread_cache(), obj);
+    }
+    if (obj->gc_flags & ZataGcFlag::PENDING) {
+        heap.publish(heap.thread_cache());
+        if (obj->gc_flags & ZataGcFlag::PENDING) {
+            obj->gc_flags |= ZataGcFlag::OLD;
+        }
+    }
+    if ((obj->gc_flags & (ZataGcFlag::OLD | ZataGcFlag::IMMORTAL)) == ZataGcFlag::OLD) {
+        heap.remember(obj);
+    }
+}
+
+inline void ZataHeap::unpin(ZataObject* obj) {
+    if (obj->gc_pins != UINT16_MAX) {
+        obj->gc_pins -= 1;
+    }
+}
+
+// 线索化指令单元, 共8字节: 处理程序(相对于分发基址的偏移, 见vm_deps/Dispatch.hpp) + 原始值(作为操作数时使用)
+struct ZataThreadedCell {
+    int32_t handler = 0;
+    int32_t operand = 0;
+};
+
+static_assert(sizeof(ZataThreadedCell) == 8, "threaded cells must stay 8 bytes");
+
 // 字节码对象
+// co_code的存储: 紧凑编码的字节(见vm_deps/Bytecode.hpp), 自己持有, 或者借用外部内存(映射进来的.zir文件)中的一段,
+// 借用时由owner保证那段内存不先于代码对象释放. slots是解码后的int个数, 跳转偏移和line_map都以它为单位
+// co_code只读, 虚拟机执行的是由它(或优化后的optimized_code)生成的threaded_code
+class ZataCodeBuffer {
+public:
+    ZataCodeBuffer() = default;
+    ZataCodeBuffer(std::vector<uint8_t> bytes, const size_t slots) : owned(std::move(bytes)), slot_count(slots) {
+        this->ptr = this->owned.data();
+        this->count = this->owned.size();
+    }
+    ZataCodeBuffer(const ZataCodeBuffer& other)
+        : owned(other.owned), owner(other.owner), count(other.count), slot_count(other.slot_count) {
+        this->ptr = other.owner ? other.ptr : this->owned.data();
+    }
+    ZataCodeBuffer(ZataCodeBuffer&& other) noexcept
+        : owned(std::move(other.owned)), owner(std::move(other.owner)), ptr(other.ptr),
+          count(other.count), slot_count(other.slot_count) {
+        other.ptr = nullptr;
+        other.count = 0;
+        other.slot_count = 0;
+    }
+    ZataCodeBuffer& operator=(ZataCodeBuffer other) noexcept {
+        std::swap(this->owned, other.owned);  // vector交换后数据指针不变
+        std::swap(this->owner, other.owner);
+        std::swap(this->ptr, other.ptr);
+        std::swap(this->count, other.count);
+        std::swap(this->slot_count, other.slot_count);
+        return *this;
+    }
+
+    void borrow(const uint8_t* data, const size_t size, const size_t slots, std::shared_ptr<const void> data_owner) {
+        this->owned.clear();
+        this->owner = std::move(data_owner);
+        this->ptr = data;
+        this->count = size;
+        this->slot_count = slots;
+    }
+
+    [[nodiscard]] bool borrowed() const {
+        return this->owner != nullptr;
+    }
+
+    [[nodiscard]] const uint8_t* data() const { return this->ptr; }
+    [[nodiscard]] size_t size() const { return this->count; }       // 字节数
+    [[nodiscard]] size_t slots() const { return this->slot_count; } // 解码后的int个数
+    [[nodiscard]] bool empty() const { return this->count == 0; }
+
+private:
+    std::vector<uint8_t> owned;
+    std::shared_ptr<const void> owner;
+    const uint8_t* ptr = nullptr;
+    size_t count = 0;
+    size_t slot_count = 0;
+};
+
 struct ZataCodeObject final : ZataObject {
+    static constexpr ZataKind KIND = ZataKind::CodeObject;
+    ZataCodeObject() : ZataObject(KIND) {}
+    ZataCodeObject(const ZataCodeObject&) = delete;  // 带有虚拟机缓存(内联缓存不可拷贝)
+
     std::vector<ZataObjectPtr> locals{};
     std::vector<ZataObjectPtr> consts;
-    std::vector<int> co_code; // co -> code_object
+    ZataCodeBuffer co_code; // co -> code_object
     std::vector<std::pair<int, int>> line_map; // line_in_zata_file , line_in_code(max)
+    int max_stack = 0; // 操作数栈最大深度, 0表示未知(由虚拟机估算)
+
+    // 以下为虚拟机生成的缓存, co_code/consts/locals被改写后需要调用invalidate()
+    // 窥孔优化的结果也只放在这里, co_code/consts/line_map始终保持前端(或.zir文件)给出的样子
+    bool optimized = false;                        // optimized_code有效: 虚拟机执行它而不是co_code
+    ZataCodeBuffer optimized_code{};               // 优化后的指令流(见vm_deps/Optimizer.hpp)
+    std::vector<ZataObjectPtr> folded_consts{};    // 常量折叠的结果, 下标接在consts之后
+    std::vector<ZataThreadedCell> threaded_code{}; // 由执行的指令流生成的线索化指令流(两种分发方式共用), 可被快速化改写
+    std::vector<int16_t> quick_counters{};         // 每个指令位置的快速化计数器
+    std::vector<std::unique_ptr<ZataAttrCache>> attr_caches{}; // GET_ATTR/SET_ATTR站点的内联缓存, 按指令位置
+    std::vector<ZataValue> const_values{};         // 拆箱后的常量池
+    std::vector<ZataValue> local_values{};         // 拆箱后的局部变量初值
+    bool values_ready = false;
+    int estimated_stack = 0;                       // 未校验且max_stack为0时虚拟机估算的深度
+    bool verified = false;                         // 已通过字节码校验(vm_deps/Verifier.hpp), 下面几项只在此时有效
+    int verified_stack = 0;                        // 校验得出的操作数栈最大深度
+    int local_slots = 0;                           // 用到的局部变量槽位数(最大下标+1)
+    int global_slots = 0;                          // 用到的全局变量槽位数
+    int ret_depth = -1;                            // RET处的栈深度, -1为没有RET, -2为各处不一致
+
+    // 虚拟机执行(以及校验)的指令流
+    [[nodiscard]] const ZataCodeBuffer& exec_code() const {
+        return this->optimized ? this->optimized_code : this->co_code;
+    }
+
+    // 执行时可用的常量个数: consts加上折叠出的常量
+    [[nodiscard]] size_t const_count() const {
+        return this->consts.size() + this->folded_consts.size();
+    }
+
+    [[nodiscard]] ZataObject* constant(const size_t index) const {
+        return index < this->consts.size() ? this->consts[index] : this->folded_consts[index - this->consts.size()];
+    }
+
+    void invalidate() {
+        this->optimized = false;
+        this->optimized_code = ZataCodeBuffer();
+        this->folded_consts.clear();
+        this->threaded_code.clear();
+        this->quick_counters.clear();
+        this->attr_caches.clear();
+        this->const_values.clear();
+        this->local_values.clear();
+        this->values_ready = false;
+        this->estimated_stack = 0;
+        this->verified = false;
+    }
 };
 
+// 原生函数: 内置函数和SLL导出函数共用的签名
+using ZataNativeFunction = ZataObjectPtr (*)(const std::vector<ZataObjectPtr>&);
+
 // 模块对象
 struct ZataModule final : ZataObject {
+    static constexpr ZataKind KIND = ZataKind::Module;
+    ZataModule() : ZataObject(KIND) {}
+
     std::string object_name;
     std::string module_path;
     size_t global_count;
     std::vector<std::string> names;
-    std::unordered_map<std::string, std::shared_ptr<ZataObject>> attrs;
-    std::shared_ptr<ZataCodeObject> code;
+    std::unordered_map<std::string, ZataObjectPtr> attrs;
+    ZataCodeObject* code = nullptr;
     std::vector<std::string> exports{};
+    std::vector<ZataNativeFunction> sll_functions{}; // 已解析的导出函数(与exports一一对应, 由虚拟机填充)
 };
 
 // 函数对象
 struct ZataFunction final : ZataObject {
+    static constexpr ZataKind KIND = ZataKind::Function;
+    ZataFunction() : ZataObject(KIND) {}
+
     std::string object_name;
     int arg_count = 0;
-    std::shared_ptr<ZataCodeObject> code;
+    ZataCodeObject* code = nullptr;
     std::vector<std::string> free_vars_names{};
-    std::unordered_map<std::string, std::shared_ptr<ZataObject>> free_vars{};
+    std::unordered_map<std::string, ZataObjectPtr> free_vars{};
+
+    // 由链接步骤填写, object_name/arg_count/code改变后需要重新链接
+    bool linked = false;
+    size_t linked_globals = 0;             // 链接(校验)时虚拟机的全局变量个数
+    int builtin_index = -1;                // 内置函数表中的下标, -1表示字节码函数
+    ZataNativeFunction native = nullptr;   // 内置函数的入口, 字节码函数为空
 };
 
 // 类对象
 struct ZataClass final : ZataObject {
+    static constexpr ZataKind KIND = ZataKind::Class;
+    ZataClass() : ZataObject(KIND) {}
+
     std::string object_name;
 
-    std::vector<std::shared_ptr<ZataClass>> parent_class;
+    std::vector<ZataClass*> parent_class;
     std::vector<std::string> names;
-    std::unordered_map<std::string, std::shared_ptr<ZataObject>> attrs;
+    std::unordered_map<std::string, ZataObjectPtr> attrs;
+
+    // 本类实例的shape转移树的根
+    const ZataShapeRef& instance_shape() {
+        if (!this->root_shape) {
+            this->root_shape = ZataShapeRef::make();
+            this->root_shape->class_rooted = true;
+        }
+        return this->root_shape;
+    }
+
+private:
+    ZataShapeRef root_shape;
 };
 
 // 实例对象
 struct ZataInstance final : ZataObject {
-    std::shared_ptr<ZataUserType> object_type;
-    std::shared_ptr<ZataClass> ref_class;
-    std::vector<std::string> names;
-    std::unordered_map<std::string,ZataObjectPtr> fields;
+    static constexpr ZataKind KIND = ZataKind::Instance;
+    ZataInstance() : ZataObject(KIND) {}
+
+    ZataUserType* object_type = nullptr;
+    ZataClass* ref_class = nullptr;
+    std::vector<std::string> names;     // 为空时字段名取自ref_class->names
+    ZataShapeRef shape;                 // 字段布局, 为空表示还没有字段
+    std::vector<ZataValue> slots;       // 字段值, 顺序与shape->keys一致
+
+    // GET_ATTR/SET_ATTR的操作数所指的字段名表
+    [[nodiscard]] const std::vector<std::string>& field_names() const {
+        if (this->names.empty() && this->ref_class) {
+            return this->ref_class->names;
+        }
+        return this->names;
+    }
+
+    // 字段名表是否由类提供(只有这时站点上的内联缓存才能只按shape判断命中)
+    [[nodiscard]] bool cacheable() const {
+        return this->names.empty() && this->shape && this->shape->class_rooted;
+    }
+
+    // 当前shape的根: 有类时用类的转移树, 否则用当前线程的空根
+    [[nodiscard]] const ZataShapeRef& root_shape() const {
+        return this->ref_class ? this->ref_class->instance_shape() : ZataShape::empty_root();
+    }
+
+    [[nodiscard]] int find_field(const std::string& name) const {
+        return this->shape ? this->shape->find(name) : -1;
+    }
+
+    // 设置字段, 字段不存在时沿转移树切换到新shape
+    void set_field(const std::string& name, ZataValue value) {
+        if (!this->shape) {
+            this->shape = this->root_shape();
+        }
+        const int slot = this->shape->find(name);
+        if (slot >= 0) {
+            this->slots[slot] = std::move(value);
+            return;
+        }
+        this->shape = this->shape->with(name);
+        this->slots.push_back(std::move(value));
+    }
+
+    // 清空全部字段, 回到根shape
+    void clear_fields() {
+        this->shape = nullptr;
+        this->slots.clear();
+    }
 };
 
+// 魔术方法槽位编号
+// 二元槽位的编号与B_CALC的pattern相同, 一元槽位的编号与U_CALC的pattern相同, 虚拟机直接用pattern下标取槽位
+namespace ZataSlot {
+    // 二元运算
+    constexpr int ADD = 0;
+    constexpr int SUB = 1;
+    constexpr int MUL = 2;
+    constexpr int DIV = 3;
+    constexpr int MOD = 4;
+    constexpr int EQ = 5;
+    constexpr int WEQ = 6;
+    constexpr int LT = 7;
+    constexpr int GT = 8;
+    constexpr int LE = 9;
+    constexpr int GE = 10;
+    constexpr int BIT_AND = 11;
+    constexpr int BIT_OR = 12;
+    constexpr int BIT_XOR = 13;
+    constexpr int BINARY_COUNT = 14;
+
+    // 一元运算
+    constexpr int NEG = 0;
+    constexpr int BIT_NOT = 1;
+    constexpr int UNARY_COUNT = 2;
+}
+
+// 元类型基类, 只作为ZataBuiltinsType/ZataUserType的公共父类, 本身不带槽位
 struct ZataMetaType : ZataObject {
-    using ZataAny = std::any;
-    std::weak_ptr<ZataBuiltinsType> object_type;
-    ZataAny type_new;
-    ZataAny type_init;
-
-    ZataAny type_add;
-    ZataAny type_sub;
-    ZataAny type_mul;
-    ZataAny type_div;
-    ZataAny type_mod;
-    ZataAny type_neg;
-    ZataAny type_eq;
-    ZataAny type_weq;
-    ZataAny type_gt;
-    ZataAny type_lt;
-    ZataAny type_ge;
-    ZataAny type_le;
-    ZataAny type_bit_and;
-    ZataAny type_bit_not;
-    ZataAny type_bit_or;
-    ZataAny type_bit_xor;
-
-    ZataAny type_nil;
-    ZataAny type_str;
-    ZataAny type_getitem;
-    ZataAny type_setitem;
-    ZataAny type_delitem;
-    ZataAny type_call;
-    ZataAny type_del;
+    static constexpr bool accepts(const ZataKind kind) {
+        return kind >= ZataKind::MetaType && kind <= ZataKind::UserType;
+    }
+    explicit ZataMetaType(const ZataKind _kind = ZataKind::MetaType) : ZataObject(_kind) {}
 };
 
 // 内置类型对象
+// 槽位都是普通函数指针, 按参数个数区分签名; 未绑定的槽位为nullptr
 struct ZataBuiltinsType final : ZataMetaType {
-    using ZataCppFnPtr = std::function<ZataObjectPtr(const std::vector<ZataObjectPtr>&)>;
-    std::weak_ptr<ZataBuiltinsType> object_type;
-    ZataCppFnPtr type_new;
-    ZataCppFnPtr type_init;
-
-    ZataCppFnPtr type_add;
-    ZataCppFnPtr type_sub;
-    ZataCppFnPtr type_mul;
-    ZataCppFnPtr type_div;
-    ZataCppFnPtr type_mod;
-    ZataCppFnPtr type_neg;
-    ZataCppFnPtr type_eq;
-    ZataCppFnPtr type_weq;
-    ZataCppFnPtr type_gt;
-    ZataCppFnPtr type_lt;
-    ZataCppFnPtr type_ge;
-    ZataCppFnPtr type_le;
-    ZataCppFnPtr type_bit_and;
-    ZataCppFnPtr type_bit_not;
-    ZataCppFnPtr type_bit_or;
-    ZataCppFnPtr type_bit_xor;
-
-    ZataCppFnPtr type_nil;
-    ZataCppFnPtr type_str;
-    ZataCppFnPtr type_getitem;
-    ZataCppFnPtr type_setitem;
-    ZataCppFnPtr type_delitem;
-    ZataCppFnPtr type_call;
-    ZataCppFnPtr type_del;
+    static constexpr ZataKind KIND = ZataKind::BuiltinsType;
+    ZataBuiltinsType() : ZataMetaType(KIND) {}
+
+    using ZataUnarySlot = ZataObjectPtr (*)(ZataObject* self);
+    using ZataBinarySlot = ZataObjectPtr (*)(ZataObject* self, ZataObject* other);
+    // 容器需要保存key/value的所有权, 所以item槽位传共享指针
+    using ZataGetItemSlot = ZataObjectPtr (*)(ZataObject* self, const ZataObjectPtr& key);
+    using ZataSetItemSlot = ZataObjectPtr (*)(ZataObject* self, const ZataObjectPtr& key, const ZataObjectPtr& value);
+    using ZataCallSlot = ZataObjectPtr (*)(const std::vector<ZataObjectPtr>& args);
+
+    ZataBuiltinsType* object_type = nullptr;
+    ZataCallSlot type_new = nullptr;
+    ZataCallSlot type_init = nullptr;
+
+    std::array<ZataBinarySlot, ZataSlot::BINARY_COUNT> binary_slots{}; // 下标为ZataSlot::ADD ~ BIT_XOR
+    std::array<ZataUnarySlot, ZataSlot::UNARY_COUNT> unary_slots{};    // 下标为ZataSlot::NEG / BIT_NOT
+
+    ZataUnarySlot type_nil = nullptr;
+    ZataUnarySlot type_str = nullptr;
+    ZataGetItemSlot type_getitem = nullptr;
+    ZataSetItemSlot type_setitem = nullptr;
+    ZataGetItemSlot type_delitem = nullptr;
+    ZataCallSlot type_call = nullptr;
+    ZataUnarySlot type_del = nullptr;
 };
 
 struct ZataUserType final : ZataMetaType {
-    using ZataFnPtr = std::shared_ptr<ZataFunction>;
-    std::weak_ptr<ZataBuiltinsType> object_type;
-    ZataFnPtr type_new;
-    ZataFnPtr type_init;
-
-    ZataFnPtr type_add;
-    ZataFnPtr type_sub;
-    ZataFnPtr type_mul;
-    ZataFnPtr type_div;
-    ZataFnPtr type_mod;
-    ZataFnPtr type_neg;
-    ZataFnPtr type_eq;
-    ZataFnPtr type_weq;
-    ZataFnPtr type_gt;
-    ZataFnPtr type_lt;
-    ZataFnPtr type_ge;
-    ZataFnPtr type_le;
-    ZataFnPtr type_bit_and;
-    ZataFnPtr type_bit_not;
-    ZataFnPtr type_bit_or;
-    ZataFnPtr type_bit_xor;
-
-    ZataFnPtr type_nil;
-    ZataFnPtr type_str;
-    ZataFnPtr type_getitem;
-    ZataFnPtr type_setitem;
-    ZataFnPtr type_delitem;
-    ZataFnPtr type_call;
-    ZataFnPtr type_del;
+    static constexpr ZataKind KIND = ZataKind::UserType;
+    ZataUserType() : ZataMetaType(KIND) {}
+
+    using ZataFnPtr = ZataFunction*;
+    ZataBuiltinsType* object_type = nullptr;
+    ZataFnPtr type_new = nullptr;
+    ZataFnPtr type_init = nullptr;
+
+    ZataFnPtr type_add = nullptr;
+    ZataFnPtr type_sub = nullptr;
+    ZataFnPtr type_mul = nullptr;
+    ZataFnPtr type_div = nullptr;
+    ZataFnPtr type_mod = nullptr;
+    ZataFnPtr type_neg = nullptr;
+    ZataFnPtr type_eq = nullptr;
+    ZataFnPtr type_weq = nullptr;
+    ZataFnPtr type_gt = nullptr;
+    ZataFnPtr type_lt = nullptr;
+    ZataFnPtr type_ge = nullptr;
+    ZataFnPtr type_le = nullptr;
+    ZataFnPtr type_bit_and = nullptr;
+    ZataFnPtr type_bit_not = nullptr;
+    ZataFnPtr type_bit_or = nullptr;
+    ZataFnPtr type_bit_xor = nullptr;
+
+    ZataFnPtr type_nil = nullptr;
+    ZataFnPtr type_str = nullptr;
+    ZataFnPtr type_getitem = nullptr;
+    ZataFnPtr type_setitem = nullptr;
+    ZataFnPtr type_delitem = nullptr;
+    ZataFnPtr type_call = nullptr;
+    ZataFnPtr type_del = nullptr;
 };
 
+// 内置数据类型的类型对象, 下标为kind, 由builtins/builtins_type.hpp创建类型对象时填写
+inline std::array<ZataBuiltinsType*, ZATA_KIND_COUNT> builtins_types{};
+
 struct ZataBuiltinsClass : ZataObject {
-    std::shared_ptr<ZataBuiltinsType> object_type;
-    std::any val;
-    ~ZataBuiltinsClass() override = default;
+    static constexpr bool accepts(const ZataKind kind) {
+        return kind >= ZataKind::BuiltinsClass && kind <= ZataKind::State;
+    }
+    explicit ZataBuiltinsClass(const ZataKind _kind = ZataKind::BuiltinsClass) : ZataObject(_kind) {}
+
+    // 类型由kind决定, 没有绑定类型(如State)时为nullptr
+    [[nodiscard]] ZataBuiltinsType* object_type() const {
+        return builtins_types[static_cast<size_t>(this->kind)];
+    }
 };
 
 // 字符串对象
 struct ZataString final : ZataBuiltinsClass {
+    static constexpr ZataKind KIND = ZataKind::String;
+    ZataString() : ZataBuiltinsClass(KIND) {}
+
     std::string val;
 };
 
 // 整数对象
 struct ZataInt final : ZataBuiltinsClass {
+    static constexpr ZataKind KIND = ZataKind::Int;
+    ZataInt() : ZataBuiltinsClass(KIND) {}
+
     int val;
 };
 
 // 长整数
 struct ZataInt64 final : ZataBuiltinsClass {
+    static constexpr ZataKind KIND = ZataKind::Int64;
+    ZataInt64() : ZataBuiltinsClass(KIND) {}
+
     long long val;
 };
 
 // 无限整数
 struct ZataInfInt final : ZataBuiltinsClass {
+    static constexpr ZataKind KIND = ZataKind::InfInt;
+    ZataInfInt() : ZataBuiltinsClass(KIND) {}
+
     bool is_negative;  // false -> +n , true -> -n
     std::vector<uint64_t> digits;
     static constexpr uint64_t BASE = 1000000000;
@@ -211,16 +654,25 @@ struct ZataInfInt final : ZataBuiltinsClass {
 
 // 浮点数对象
 struct ZataFloat final : ZataBuiltinsClass {
+    static constexpr ZataKind KIND = ZataKind::Float;
+    ZataFloat() : ZataBuiltinsClass(KIND) {}
+
     float val;
 };
 
 // 长浮点数对象
 struct ZataFloat64 final : ZataBuiltinsClass {
+    static constexpr ZataKind KIND = ZataKind::Float64;
+    ZataFloat64() : ZataBuiltinsClass(KIND) {}
+
     double val;
 };
 
 // 安全小数
 struct ZataDec final : ZataBuiltinsClass {
+    static constexpr ZataKind KIND = ZataKind::Dec;
+    ZataDec() : ZataBuiltinsClass(KIND) {}
+
     bool is_negative;
     std::vector<uint64_t> int_digits;
     std::vector<uint64_t> frac_digits;
@@ -231,28 +683,43 @@ struct ZataDec final : ZataBuiltinsClass {
 
 // 列表
 struct ZataList final : ZataBuiltinsClass {
+    static constexpr ZataKind KIND = ZataKind::List;
+    ZataList() : ZataBuiltinsClass(KIND) {}
+
     std::vector<ZataObjectPtr> items;
     size_t size;
 };
 
 // 字典
 struct ZataDict final : ZataBuiltinsClass {
+    static constexpr ZataKind KIND = ZataKind::Dict;
+    ZataDict() : ZataBuiltinsClass(KIND) {}
+
     std::unordered_map<ZataObjectPtr, ZataObjectPtr> key_val;
 };
 
 // 元组
 struct ZataTuple final : ZataBuiltinsClass {
+    static constexpr ZataKind KIND = ZataKind::Tuple;
+    ZataTuple() : ZataBuiltinsClass(KIND) {}
+
     std::vector<ZataObjectPtr> items;
 };
 
 
 // 记录
 struct ZataRecord final : ZataBuiltinsClass {
+    static constexpr ZataKind KIND = ZataKind::Record;
+    ZataRecord() : ZataBuiltinsClass(KIND) {}
+
     std::unordered_map<std::string, ZataObjectPtr> attrs;
 };
 
 // 状态
 struct ZataState final : ZataBuiltinsClass {
+    static constexpr ZataKind KIND = ZataKind::State;
+    ZataState() : ZataBuiltinsClass(KIND) {}
+
     // 布尔假     False = 0
     // 布尔真     True = 1
     // 空值       None = 2
@@ -260,4 +727,43 @@ struct ZataState final : ZataBuiltinsClass {
     int val = 2;
 };
 
+// -------------------------- 基于kind的类型转换 --------------------------
+
+template <typename T>
+constexpr bool zata_kind_matches(const ZataKind kind) {
+    if constexpr (requires { T::KIND; }) {
+        return kind == T::KIND;
+    } else {
+        return T::accepts(kind);
+    }
+}
+
+// 代替dynamic_cast: 只比较对象头里的kind, 类型不符返回nullptr
+template <typename T>
+T* zata_cast(ZataObject* obj) {
+    return (obj && zata_kind_matches<T>(obj->kind)) ? static_cast<T*>(obj) : nullptr;
+}
+
+template <typename T>
+const T* zata_cast(const ZataObject* obj) {
+    return (obj && zata_kind_matches<T>(obj->kind)) ? static_cast<const T*>(obj) : nullptr;
+}
+
+// 对象的类型: 内置数据对象按kind查表, 实例/元类型取各自的object_type字段, 其余为nullptr
+inline ZataMetaType* zata_type_of(const ZataObject* obj) {
+    if (const auto* builtins_obj = zata_cast<ZataBuiltinsClass>(obj)) {
+        return builtins_obj->object_type();
+    }
+    if (const auto* instance = zata_cast<ZataInstance>(obj)) {
+        return instance->object_type;
+    }
+    if (const auto* builtins_type = zata_cast<ZataBuiltinsType>(obj)) {
+        return builtins_type->object_type;
+    }
+    if (const auto* user_type = zata_cast<ZataUserType>(obj)) {
+        return user_type->object_type;
+    }
+    return nullptr;
+}
+
 #endif // ZATA_OBJECTS_H
@@ -0,0 +1,149 @@
+#ifndef ZATA_SHAPE_H
+#define ZATA_SHAPE_H
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+// 隐藏类(shape): 描述实例的字段布局, 字段名 -> 槽位下标
+// 按 "字段加入的顺序" 组成转移树: 以相同顺序设置相同字段的实例共享同一个shape,
+// 实例本身只需要保存shape和一个按槽位排列的值数组
+// 子shape由父shape的transitions持有, 整棵树由根(类或线程的空根)持有, 实例持有自己当前的shape
+struct ZataShape;
+
+// shape的侵入式引用: 计数放在ZataShape里, 不是原子的
+// shape和对象一样只在持有解释器的线程上使用(同一时刻只有一个线程在跑虚拟机), 因此不需要原子操作;
+// 要交给别的线程独立使用, 需要先在当前线程复制一份, 不能直接共享同一棵转移树
+class ZataShapeRef {
+public:
+    ZataShapeRef() = default;
+    ZataShapeRef(std::nullptr_t) {}
+    explicit ZataShapeRef(ZataShape* shape);
+    ZataShapeRef(const ZataShapeRef& other) : ZataShapeRef(other.ptr) {}
+    ZataShapeRef(ZataShapeRef&& other) noexcept : ptr(other.ptr) {
+        other.ptr = nullptr;
+    }
+    ~ZataShapeRef();
+
+    ZataShapeRef& operator=(ZataShapeRef other) noexcept {
+        std::swap(this->ptr, other.ptr);
+        return *this;
+    }
+
+    [[nodiscard]] ZataShape* get() const {
+        return this->ptr;
+    }
+    ZataShape* operator->() const {
+        return this->ptr;
+    }
+    ZataShape& operator*() const {
+        return *this->ptr;
+    }
+    explicit operator bool() const {
+        return this->ptr != nullptr;
+    }
+    bool operator==(const ZataShapeRef& other) const {
+        return this->ptr == other.ptr;
+    }
+
+    static ZataShapeRef make();
+
+private:
+    ZataShape* ptr = nullptr;
+};
+
+struct ZataShape {
+    std::vector<std::string> keys;  // 槽位下标 -> 字段名
+    bool class_rooted = false;      // 是否属于某个类的转移树(只有这样的shape才能进入内联缓存)
+    uint32_t refs = 0;              // 引用计数, 由ZataShapeRef维护
+    std::unordered_map<std::string, ZataShapeRef> transitions;
+
+    // 字段所在的槽位, 不存在返回-1
+    [[nodiscard]] int find(const std::string& name) const {
+        for (size_t i = 0; i < this->keys.size(); ++i) {
+            if (this->keys[i] == name) {
+                return static_cast<int>(i);
+            }
+        }
+        return -1;
+    }
+
+    // 加入一个新字段后的shape(已有的转移直接复用)
+    const ZataShapeRef& with(const std::string& name) {
+        auto& next = this->transitions[name];
+        if (!next) {
+            next = ZataShapeRef::make();
+            next->keys = this->keys;
+            next->keys.push_back(name);
+            next->class_rooted = this->class_rooted;
+        }
+        return next;
+    }
+
+    // 不属于任何类的实例使用的根, 每个线程一棵
+    // 根的引用计数和转移表都不是线程安全的, 各线程上的虚拟机因此不能共用一个进程级的根
+    static const ZataShapeRef& empty_root() {
+        static thread_local const auto root = ZataShapeRef::make();
+        return root;
+    }
+};
+
+inline ZataShapeRef::ZataShapeRef(ZataShape* shape) : ptr(shape) {
+    if (this->ptr) {
+        this->ptr->refs += 1;
+    }
+}
+
+inline ZataShapeRef::~ZataShapeRef() {
+    if (this->ptr && --this->ptr->refs == 0) {
+        delete this->ptr;
+    }
+}
+
+inline ZataShapeRef ZataShapeRef::make() {
+    return ZataShapeRef(new ZataShape());
+}
+
+// GET_ATTR/SET_ATTR站点的内联缓存, 以shape为键
+// 单态时只用第一项, 最多同时记住ZVM_ATTR_CACHE_WAYS个shape(多态), 满了按轮转替换
+// 缓存持有shape的引用, 因此不会出现shape被释放后地址复用导致的误命中
+#ifndef ZVM_ATTR_CACHE_WAYS
+#define ZVM_ATTR_CACHE_WAYS 4
+#endif
+
+struct ZataAttrCache {
+    struct Entry {
+        ZataShapeRef shape;  // 命中条件: 实例当前的shape
+        ZataShapeRef next;   // SET_ATTR新增字段时转移到的shape, 其余情况为空
+        int slot = -1;
+    };
+
+    std::array<Entry, ZVM_ATTR_CACHE_WAYS> entries{};
+    uint8_t victim = 0;
+
+    [[nodiscard]] const Entry* find(const ZataShape* shape) const {
+        if (!shape) {
+            return nullptr;
+        }
+        for (const auto& entry : this->entries) {
+            if (entry.shape.get() == shape) {
+                return &entry;
+            }
+        }
+        return nullptr;
+    }
+
+    void insert(const ZataShapeRef& shape, const int slot, const ZataShapeRef& next = nullptr) {
+        Entry& entry = this->entries[this->victim];
+        this->victim = static_cast<uint8_t>((this->victim + 1) % ZVM_ATTR_CACHE_WAYS);
+        entry.shape = shape;
+        entry.next = next;
+        entry.slot = slot;
+    }
+};
+
+#endif // ZATA_SHAPE_H
@@ -0,0 +1,343 @@
+#ifndef ZATA_TRACE_H
+#define ZATA_TRACE_H
+
+#include "models/Heap.hpp"
+#include "models/Objects.hpp"
+
+// 精确追踪: 按kind列出对象直接引用的全部对象
+// 新增引用其它对象的字段时必须同时加在这里, 否则被引用的对象会被当作垃圾回收
+inline void zata_trace(ZataObject& obj, ZataHeap& heap) {
+    switch (obj.kind) {
+        case ZataKind::CodeObject: {
+            auto& code_object = static_cast<ZataCodeObject&>(obj);
+            for (auto* item : code_object.locals) {
+                heap.mark(item);
+            }
+            for (auto* item : code_object.consts) {
+                heap.mark(item);
+            }
+            for (auto* item : code_object.folded_consts) {
+                heap.mark(item);
+            }
+            // 拆箱缓存可能还引用着被替换掉(尚未invalidate)的常量
+            for (const auto& value : code_object.const_values) {
+                heap.mark(value);
+            }
+            for (const auto& value : code_object.local_values) {
+                heap.mark(value);
+            }
+            break;
+        }
+        case ZataKind::Module: {
+            auto& module = static_cast<ZataModule&>(obj);
+            for (const auto& [name, attr] : module.attrs) {
+                heap.mark(attr);
+            }
+            heap.mark(module.code);
+            break;
+        }
+        case ZataKind::Function: {
+            auto& function = static_cast<ZataFunction&>(obj);
+            heap.mark(function.code);
+            for (const auto& [name, var] : function.free_vars) {
+                heap.mark(var);
+            }
+            break;
+        }
+        case ZataKind::Class: {
+            auto& class_obj = static_cast<ZataClass&>(obj);
+            for (auto* parent : class_obj.parent_class) {
+                heap.mark(parent);
+            }
+            for (const auto& [name, attr] : class_obj.attrs) {
+                heap.mark(attr);
+            }
+            break;
+        }
+        case ZataKind::Instance: {
+            auto& instance = static_cast<ZataInstance&>(obj);
+            heap.mark(instance.object_type);
+            heap.mark(instance.ref_class);
+            for (const auto& value : instance.slots) {
+                heap.mark(value);
+            }
+            break;
+        }
+        case ZataKind::BuiltinsType:
+            heap.mark(static_cast<ZataBuiltinsType&>(obj).object_type);
+            break;
+        case ZataKind::UserType: {
+            auto& type = static_cast<ZataUserType&>(obj);
+            heap.mark(type.object_type);
+            for (auto* slot : {type.type_new, type.type_init, type.type_add, type.type_sub, type.type_mul,
+                               type.type_div, type.type_mod, type.type_neg, type.type_eq, type.type_weq,
+                               type.type_gt, type.type_lt, type.type_ge, type.type_le, type.type_bit_and,
+                               type.type_bit_not, type.type_bit_or, type.type_bit_xor, type.type_nil,
+                               type.type_str, type.type_getitem, type.type_setitem, type.type_delitem,
+                               type.type_call, type.type_del}) {
+                heap.mark(slot);
+            }
+            break;
+        }
+        case ZataKind::List:
+            for (auto* item : static_cast<ZataList&>(obj).items) {
+                heap.mark(item);
+            }
+            break;
+        case ZataKind::Dict:
+            for (const auto& [key, value] : static_cast<ZataDict&>(obj).key_val) {
+                heap.mark(key);
+                heap.mark(value);
+            }
+            break;
+        case ZataKind::Tuple:
+            for (auto* item : static_cast<ZataTuple&>(obj).items) {
+                heap.mark(item);
+            }
+            break;
+        case ZataKind::Record:
+            for (const auto& [name, attr] : static_cast<ZataRecord&>(obj).attrs) {
+                heap.mark(attr);
+            }
+            break;
+        default:
+            break;
+    }
+}
+
+// 次要回收的标记阶段(竞技场结束时也用它): 只追踪新生代, 根是固定的新生代对象 + 记忆集 + 各虚拟机的根
+// 标记时跳过老年代对象(skip_flags), 它们对新生代的引用由记忆集里的对象给出
+inline void ZataHeap::mark_young() {
+    this->merge_tracked();
+    this->skip_flags = ZataGcFlag::OLD;
+    for (auto* obj : this->young) {
+        if (obj->gc_pins) {
+            this->mark(obj);
+        }
+    }
+    for (auto* obj : this->remembered) {
+        obj->gc_flags |= ZataGcFlag::MARKED;
+        this->gray.push_back(obj);
+    }
+    for (auto* source : this->root_sources) {
+        source->trace_roots(*this);
+    }
+    for (size_t i = 0; i < this->gray.size(); ++i) {
+        zata_trace(*this->gray[i], *this);
+    }
+    this->skip_flags = 0;
+
+    // 存活的新生代对象接下来全部晋升, 之后老年代不再引用新生代
+    this->keep_pinned_remembered();
+}
+
+// 记忆集只留下仍被固定的对象. 固定的老年代对象总在记忆集里, 完整回收也从这里找老年代的根
+inline void ZataHeap::keep_pinned_remembered() {
+    size_t kept_remembered = 0;
+    for (auto* obj : this->remembered) {
+        if (obj->gc_pins) {
+            this->remembered[kept_remembered++] = obj;
+        } else {
+            obj->gc_flags &= ~ZataGcFlag::REMEMBERED;
+        }
+    }
+    this->remembered.resize(kept_remembered);
+}
+
+inline void ZataHeap::promote(ZataObject* obj) {
+    obj->gc_flags |= ZataGcFlag::OLD;
+    this->objects.push_back(obj);
+    if (obj->gc_pins) {
+        this->remember(obj);
+    }
+}
+
+// 次要回收结束后的收尾: 清除标记位, 新生代清空
+// 存活的对象此时都是老年代, 除了还在某个线程缓冲里的: 它们可能已被老年代引用, 同样算作老年代(并入时进入objects)
+inline void ZataHeap::finish_young(const size_t freed) {
+    this->promoted_total += this->young.size() - freed;
+    this->young.clear();
+    for (auto* obj : this->gray) {
+        obj->gc_flags = (obj->gc_flags & ~ZataGcFlag::MARKED) | ZataGcFlag::OLD;
+    }
+    this->gray.clear();
+    this->freed_total += freed;
+    this->young_bytes = 0;
+    this->drain_abandoned_pools();
+}
+
+// 次要回收(竞技场期间不做): 释放新生代中不可达的对象, 存活的全部晋升
+inline size_t ZataHeap::collect_young() {
+    if (this->arena_depth) {
+        return 0;
+    }
+    this->mark_young();
+    size_t freed = 0;
+    for (auto* obj : this->young) {
+        if (obj->gc_flags & ZataGcFlag::MARKED) {
+            this->promote(obj);
+        } else {
+            obj->gc_flags |= ZataGcFlag::FREEING;
+            delete obj;
+            freed += 1;
+        }
+    }
+    this->finish_young(freed);
+    this->minor_collections += 1;
+    return freed;
+}
+
+// 进入竞技场, 需在安全点调用. 先做一次次要回收, 结束时新生代里就只有竞技场期间创建的对象
+inline void ZataHeap::begin_arena() {
+    if (this->arena_depth == 0) {
+        this->merge_tracked();
+        if (!this->young.empty()) {
+            this->collect_young();
+        }
+        this->arena_pool = this->thread_pool(true);
+        this->arena_pool->begin_arena();
+    }
+    this->arena_depth += 1;
+}
+
+// 离开竞技场: 按次要回收标记, 可达的对象照常晋升(所在的块变成普通的块)
+// 没有登记的竞技场对象只会出现在gray里, 存活的这时补上登记并晋升, 死去的什么也不做
+// 登记了的竞技场对象死去时只析构, 内存和前者一样: 没有存活对象的块整块交还对象池, 其余块重建空闲链表
+inline size_t ZataHeap::end_arena() {
+    if (--this->arena_depth) {
+        return 0;
+    }
+    this->mark_young();
+    std::vector<void*>& survivors = this->arena_survivors;
+    for (auto* obj : this->gray) {
+        if (obj->gc_flags & ZataGcFlag::UNTRACKED) {
+            obj->gc_flags &= ~ZataGcFlag::UNTRACKED;
+            this->promote(obj);
+            this->promoted_total += 1;
+            survivors.push_back(obj);
+        }
+    }
+    size_t freed = 0;
+    size_t arena_freed = 0;
+    for (auto* obj : this->young) {
+        if (obj->gc_flags & ZataGcFlag::MARKED) {
+            this->promote(obj);
+            if (obj->gc_flags & ZataGcFlag::ARENA) {
+                survivors.push_back(obj);
+            }
+            continue;
+        }
+        obj->gc_flags |= ZataGcFlag::FREEING;
+        if (obj->gc_flags & ZataGcFlag::ARENA) {
+            obj->~ZataObject();
+            arena_freed += 1;
+        } else {
+            delete obj;
+        }
+        freed += 1;
+    }
+    std::sort(survivors.begin(), survivors.end());
+    const size_t untracked_freed = this->arena_pool->end_arena(survivors) - arena_freed;
+    survivors.clear();
+    this->arena_pool = nullptr;
+    this->finish_young(freed);
+    this->freed_total += untracked_freed;
+    this->arena_releases += 1;
+    return freed + untracked_freed;
+}
+
+// 回收时释放的对象若属于无主的池, 只是压进了它的远程释放栈; 这里代为取回, 空出来的块才能复用
+inline void ZataHeap::drain_abandoned_pools() {
+    std::lock_guard guard(this->pools_lock);
+    for (auto* pool : this->abandoned_pools) {
+        pool->drain_remote();
+    }
+}
+
+// 完整回收(竞技场期间不做). 标记: 从根出发沿zata_trace走遍可达对象; 清扫: 释放两代中所有未标记的对象
+// gray既是工作表也是本次存活对象的清单, 清扫后用它清除标记位(也覆盖不在堆中登记的对象)
+inline size_t ZataHeap::collect() {
+    if (this->arena_depth) {
+        return 0;
+    }
+    this->merge_tracked();
+    for (auto* list : {&this->young, &this->remembered}) {
+        for (auto* obj : *list) {
+            if (obj->gc_pins) {
+                this->mark(obj);
+            }
+        }
+    }
+    for (auto* source : this->root_sources) {
+        source->trace_roots(*this);
+    }
+    for (size_t i = 0; i < this->gray.size(); ++i) {
+        zata_trace(*this->gray[i], *this);
+    }
+
+    // 没有固定的对象可能在这次被释放, 先移出记忆集; 清扫后老年代不再引用新生代
+    this->keep_pinned_remembered();
+
+    const size_t before = this->young.size() + this->objects.size();
+    size_t kept = 0;
+    for (auto* obj : this->objects) {
+        if (obj->gc_flags & ZataGcFlag::MARKED) {
+            this->objects[kept++] = obj;
+        } else {
+            obj->gc_flags |= ZataGcFlag::FREEING;
+            delete obj;
+        }
+    }
+    this->objects.resize(kept);
+    for (auto* obj : this->young) {
+        if (obj->gc_flags & ZataGcFlag::MARKED) {
+            this->promote(obj);
+            this->promoted_total += 1;
+        } else {
+            obj->gc_flags |= ZataGcFlag::FREEING;
+            delete obj;
+        }
+    }
+    this->young.clear();
+    const size_t freed = before - this->objects.size();
+
+    // 同finish_young: 被标记到的缓冲中的对象算作老年代
+    for (auto* obj : this->gray) {
+        obj->gc_flags = (obj->gc_flags & ~ZataGcFlag::MARKED) | ZataGcFlag::OLD;
+    }
+    this->gray.clear();
+
+    this->drain_abandoned_pools();
+
+    this->collections += 1;
+    this->freed_total += freed;
+    this->young_bytes = 0;
+    this->threshold = std::max(this->min_threshold, this->objects.size() * 2);
+    return freed;
+}
+
+// 安全点: 新生代写满时做次要回收, 晋升使老年代超过阈值时再做完整回收(竞技场期间不回收)
+inline void ZataHeap::safe_point() {
+    if (this->collect_due()) {
+        this->collect_young();
+        if (this->objects.size() >= this->threshold) {
+            this->collect();
+        }
+    }
+}
+
+// 竞技场作用域: 作用域内新建的对象来自竞技场块, 期间不回收; 离开时只有可达的对象(固定的结果等)留下来, 其余一次释放
+// 可以嵌套, 只有最外层生效
+class ZataArenaScope {
+public:
+    ZataArenaScope() {
+        ZataHeap::instance().begin_arena();
+    }
+    ~ZataArenaScope() {
+        ZataHeap::instance().end_arena();
+    }
+    ZataArenaScope(const ZataArenaScope&) = delete;
+    ZataArenaScope& operator=(const ZataArenaScope&) = delete;
+};
+
+#endif // ZATA_TRACE_H
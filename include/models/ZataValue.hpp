@@ -0,0 +1,118 @@
+#ifndef ZATA_VALUE_H
+#define ZATA_VALUE_H
+
+#include <bit>
+#include <cmath>
+#include <cstdint>
+#include <utility>
+
+struct ZataObject;
+using ZataObjectPtr = ZataObject*;  // 对象由堆(models/Heap.hpp)管理, 引用就是裸指针
+
+// 虚拟机内部的值表示(NaN-boxing)
+// bits是一个64位字:
+//   普通double          -> 原样存放(NaN统一成CANONICAL_NAN)
+//   其它                -> 符号位+指数全1+quiet位 (0xFFF8) 之后跟3位tag, 低48位是载荷
+// 整数(ZataInt)/单精度(ZataFloat)/双精度(ZataFloat64)/状态(ZataState) 都直接存在bits里, 不分配对象
+// 堆对象的指针存在载荷里(用户态地址不超过48位), 整个值就是一个可平凡拷贝的64位字
+class ZataValue {
+public:
+    enum class Tag : uint64_t {
+        Double = 0,  // 不是装箱值, 仅用于tag()的返回
+        Empty  = 1,  // 空值(相当于空指针), 如未初始化的局部变量
+        Int    = 2,
+        Float  = 3,
+        State  = 4,
+        Object = 5,
+    };
+
+    static constexpr uint64_t BOX_PREFIX    = 0xFFF8000000000000ull;
+    static constexpr uint64_t TAG_MASK      = 0xFFFF000000000000ull;
+    static constexpr uint64_t PAYLOAD_MASK  = 0x0000FFFFFFFFFFFFull;
+    static constexpr uint64_t CANONICAL_NAN = 0x7FF8000000000000ull;
+    static constexpr int TAG_SHIFT = 48;
+
+    // ZataState的取值
+    static constexpr int STATE_FALSE = 0;
+    static constexpr int STATE_TRUE = 1;
+    static constexpr int STATE_NONE = 2;
+    static constexpr int STATE_NOT_FOUND = 3;
+
+private:
+    uint64_t bits;
+
+    static constexpr uint64_t box(const Tag tag, const uint64_t payload) {
+        return BOX_PREFIX | (static_cast<uint64_t>(tag) << TAG_SHIFT) | (payload & PAYLOAD_MASK);
+    }
+
+    [[nodiscard]] bool has_tag(const Tag tag) const {
+        return (this->bits & TAG_MASK) == box(tag, 0);
+    }
+
+    explicit ZataValue(const uint64_t _bits) : bits(_bits) {}
+
+public:
+    ZataValue() : bits(box(Tag::Empty, 0)) {}
+
+    static ZataValue from_int(const int32_t val) {
+        return ZataValue(box(Tag::Int, static_cast<uint32_t>(val)));
+    }
+
+    static ZataValue from_float(const float val) {
+        return ZataValue(box(Tag::Float, std::bit_cast<uint32_t>(val)));
+    }
+
+    static ZataValue from_double(const double val) {
+        return ZataValue(std::isnan(val) ? CANONICAL_NAN : std::bit_cast<uint64_t>(val));
+    }
+
+    static ZataValue from_state(const int state) {
+        return ZataValue(box(Tag::State, static_cast<uint32_t>(state)));
+    }
+
+    static ZataValue from_bool(const bool val) {
+        return from_state(val ? STATE_TRUE : STATE_FALSE);
+    }
+
+    static ZataValue from_object(const ZataObjectPtr obj) {
+        if (!obj) {
+            return {};
+        }
+        return ZataValue(box(Tag::Object, reinterpret_cast<uintptr_t>(obj)));
+    }
+
+    [[nodiscard]] Tag tag() const {
+        if (this->is_double()) {
+            return Tag::Double;
+        }
+        return static_cast<Tag>((this->bits >> TAG_SHIFT) & 0x7);
+    }
+
+    [[nodiscard]] bool is_double() const { return (this->bits & BOX_PREFIX) != BOX_PREFIX; }
+    [[nodiscard]] bool is_empty() const { return this->has_tag(Tag::Empty); }
+    [[nodiscard]] bool is_int() const { return this->has_tag(Tag::Int); }
+    [[nodiscard]] bool is_float() const { return this->has_tag(Tag::Float); }
+    [[nodiscard]] bool is_state() const { return this->has_tag(Tag::State); }
+    [[nodiscard]] bool is_object() const { return this->has_tag(Tag::Object); }
+
+    [[nodiscard]] int32_t as_int() const { return static_cast<int32_t>(static_cast<uint32_t>(this->bits)); }
+    [[nodiscard]] float as_float() const { return std::bit_cast<float>(static_cast<uint32_t>(this->bits)); }
+    [[nodiscard]] double as_double() const { return std::bit_cast<double>(this->bits); }
+    [[nodiscard]] int as_state() const { return static_cast<int>(static_cast<uint32_t>(this->bits)); }
+    // 不是堆对象时返回nullptr
+    [[nodiscard]] ZataObject* as_object() const {
+        return this->is_object() ? reinterpret_cast<ZataObject*>(this->bits & PAYLOAD_MASK) : nullptr;
+    }
+    [[nodiscard]] ZataObjectPtr object_ref() const { return this->as_object(); }
+
+    // 取出堆对象, 之后this变为空值
+    ZataObjectPtr take_object() {
+        ZataObjectPtr obj = this->as_object();
+        this->bits = box(Tag::Empty, 0);
+        return obj;
+    }
+
+    [[nodiscard]] uint64_t raw_bits() const { return this->bits; }
+};
+
+#endif // ZATA_VALUE_H
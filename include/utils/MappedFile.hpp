@@ -0,0 +1,86 @@
+#ifndef MAPPED_FILE_HPP
+#define MAPPED_FILE_HPP
+#include <cstddef>
+#include <fstream>
+#include <iterator>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+// 只读方式打开的整个文件. POSIX下用mmap映射(按需分页, 加载时不拷贝), 其它平台退回一次性读入内存
+// 用shared_ptr持有: 借用其中内存的对象(例如ZataCodeBuffer)各自保留一份, 最后一个释放时才解除映射
+class ZataMappedFile {
+public:
+    static std::shared_ptr<const ZataMappedFile> open(const std::string& path) {
+        return std::shared_ptr<const ZataMappedFile>(new ZataMappedFile(path));
+    }
+
+    ~ZataMappedFile() {
+    #ifndef _WIN32
+        if (this->mapped) {
+            munmap(this->mapped, this->length);
+        }
+    #endif
+    }
+
+    ZataMappedFile(const ZataMappedFile&) = delete;
+    ZataMappedFile& operator=(const ZataMappedFile&) = delete;
+
+    [[nodiscard]] const unsigned char* data() const {
+        return this->bytes;
+    }
+
+    [[nodiscard]] size_t size() const {
+        return this->length;
+    }
+
+private:
+    const unsigned char* bytes = nullptr;
+    size_t length = 0;
+    void* mapped = nullptr;
+    std::vector<unsigned char> buffer;  // 不能映射时的后备
+
+    explicit ZataMappedFile(const std::string& path) {
+    #ifndef _WIN32
+        const int fd = ::open(path.c_str(), O_RDONLY);
+        if (fd < 0) {
+            throw std::runtime_error("failed to open file: " + path);
+        }
+        struct stat info{};
+        if (fstat(fd, &info) != 0) {
+            ::close(fd);
+            throw std::runtime_error("failed to stat file: " + path);
+        }
+        this->length = static_cast<size_t>(info.st_size);
+        if (this->length) {
+            // 映射期间文件不应被改写(代码对象直接使用映射中的指令)
+            void* address = mmap(nullptr, this->length, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (address == MAP_FAILED) {
+                ::close(fd);
+                throw std::runtime_error("failed to map file: " + path);
+            }
+            this->mapped = address;
+            this->bytes = static_cast<const unsigned char*>(address);
+        }
+        ::close(fd);
+    #else
+        std::ifstream file(path, std::ios::binary);
+        if (!file.is_open()) {
+            throw std::runtime_error("failed to open file: " + path);
+        }
+        this->buffer.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+        this->bytes = this->buffer.data();
+        this->length = this->buffer.size();
+    #endif
+    }
+};
+
+#endif //MAPPED_FILE_HPP
@@ -5,6 +5,10 @@
 #include <stdexcept>
 #include <string>
 #include <memory>
+#include <mutex>
+
+#include "models/Objects.hpp"
+
 #ifdef _WIN32
 #include <windows.h>
 #else
@@ -18,110 +22,124 @@ using LibraryHandle = void*;
 #endif
 
 // 函数指针类型（使用ZataObjectPtr）
-using ZataDllFunction = ZataObjectPtr(*)(const std::vector<ZataObjectPtr>&);
+using ZataDllFunction = ZataNativeFunction;
 
-class ZataFunctionMap {
+// 进程级的SLL注册表: 每个动态库只加载一次, 每个(路径, 导出名)只解析一次
+// 库一旦加载就不再卸载 —— 库里创建的对象(及其虚表)可能比任何一次调用活得更久
+class ZataSllRegistry {
 private:
-    // 跨平台句柄类型（内部存储为void*）
-    using LibraryHandle = void*;
-
-    LibraryHandle lib_handle_;
-    std::unordered_map<std::string, ZataDllFunction> functions_;
-
-    // 修复：删除器参数统一为void*
-    struct LibraryHandleDeleter {
-        void operator()(void* h) const {  // 参数明确为void*
-            if (h != nullptr) {
-            #ifdef _WIN32
-                // Windows下转换为HMODULE后释放
-                FreeLibrary(reinterpret_cast<HMODULE>(h));
-            #else
-                // Linux/macOS下直接释放
-                dlclose(h);
-            #endif
-            }
-        }
+    struct Library {
+        LibraryHandle handle = nullptr;
+        std::unordered_map<std::string, ZataDllFunction> functions;
     };
 
-    // unique_ptr存储void*，删除器参数为void*，类型匹配
-    std::unique_ptr<void, LibraryHandleDeleter> lib_handle_wrapper_;
+    std::mutex mutex_;
+    std::unordered_map<std::string, Library> libraries_;
 
-public:
-    // 构造函数
-    ZataFunctionMap(LibraryHandle handle, const std::unordered_map<std::string, ZataDllFunction>& functions)
-        : lib_handle_(handle), functions_(functions), lib_handle_wrapper_(handle) {}
-
-    // 禁止复制，允许移动
-    ZataFunctionMap(const ZataFunctionMap&) = delete;
-    ZataFunctionMap& operator=(const ZataFunctionMap&) = delete;
-    ZataFunctionMap(ZataFunctionMap&&) = default;
-    ZataFunctionMap& operator=(ZataFunctionMap&&) = default;
-
-    // 获取函数
-    ZataDllFunction operator[](const std::string& function_name) const {
-        auto it = functions_.find(function_name);
-        if (it == functions_.end()) {
-            throw std::runtime_error("Function '" + function_name + "' not found in library");
+    ZataSllRegistry() = default;
+
+    static LibraryHandle open_library(const std::string& path) {
+        LibraryHandle handle = nullptr;
+    #ifdef _WIN32
+        handle = reinterpret_cast<LibraryHandle>(LoadLibraryA(path.c_str()));
+        if (!handle) {
+            throw std::runtime_error("Failed to load DLL: " + path +
+                                    " (Error: " + std::to_string(GetLastError()) + ")");
+        }
+    #else
+        handle = dlopen(path.c_str(), RTLD_LAZY | RTLD_GLOBAL);
+        if (!handle) {
+            throw std::runtime_error("Failed to load .so: " + path +
+                                    " (Error: " + std::string(dlerror()) + ")");
         }
-        return it->second;
+    #endif
+        return handle;
     }
-};
-
-// 加载动态库
-inline ZataFunctionMap load_sll(const std::string& path, const std::vector<std::string>& all_fn) {
-    LibraryHandle handle = nullptr;
 
+    static ZataDllFunction find_symbol(LibraryHandle handle, const std::string& fn_name) {
+        ZataDllFunction func = nullptr;
     #ifdef _WIN32
-    // Windows加载DLL（返回HMODULE，本质是void*）
-    handle = reinterpret_cast<LibraryHandle>(LoadLibraryA(path.c_str()));
-    if (!handle) {
-        throw std::runtime_error("Failed to load DLL: " + path +
-                                " (Error: " + std::to_string(GetLastError()) + ")");
-    }
+        func = reinterpret_cast<ZataDllFunction>(GetProcAddress(reinterpret_cast<HMODULE>(handle), fn_name.c_str()));
+        if (!func) {
+            throw std::runtime_error("Function '" + fn_name + "' not found (Error: " +
+                                    std::to_string(GetLastError()) + ")");
+        }
     #else
-    // Linux/macOS加载.so
-    handle = dlopen(path.c_str(), RTLD_LAZY | RTLD_GLOBAL);
-    if (!handle) {
-        throw std::runtime_error("Failed to load .so: " + path +
-                                " (Error: " + std::string(dlerror()) + ")");
+        dlerror();  // 清除错误
+        func = reinterpret_cast<ZataDllFunction>(dlsym(handle, fn_name.c_str()));
+        const char* err = dlerror();
+        if (err || !func) {
+            throw std::runtime_error("Function '" + fn_name + "' not found (Error: " +
+                                    std::string(err ? err : "Unknown") + ")");
+        }
+    #endif
+        return func;
     }
+
+    // 库和虚拟机各自编译了一份堆的实现, 把库的堆锚点指向虚拟机的堆, 库里创建的对象才会被回收
+    // 库没有用到对象模型时没有这个符号; Windows下数据符号默认不导出, 库的对象留在它自己的堆里(不会被释放)
+    static void attach_heap(LibraryHandle handle) {
+    #ifdef _WIN32
+        auto* anchor = reinterpret_cast<ZataHeap**>(GetProcAddress(reinterpret_cast<HMODULE>(handle), "zata_heap_anchor"));
+    #else
+        auto* anchor = reinterpret_cast<ZataHeap**>(dlsym(handle, "zata_heap_anchor"));
     #endif
+        if (anchor) {
+            *anchor = &ZataHeap::instance();
+        }
+    }
 
-    std::unordered_map<std::string, ZataDllFunction> functions;
+public:
+    ZataSllRegistry(const ZataSllRegistry&) = delete;
+    ZataSllRegistry& operator=(const ZataSllRegistry&) = delete;
 
-    try {
-        for (const auto& fn_name : all_fn) {
-            ZataDllFunction func = nullptr;
-            #ifdef _WIN32
-            func = reinterpret_cast<ZataDllFunction>(GetProcAddress(reinterpret_cast<HMODULE>(handle), fn_name.c_str()));
-            if (!func) {
-                throw std::runtime_error("Function '" + fn_name + "' not found (Error: " +
-                                        std::to_string(GetLastError()) + ")");
-            }
-            #else
-            dlerror();  // 清除错误
-            func = reinterpret_cast<ZataDllFunction>(dlsym(handle, fn_name.c_str()));
-            const char* err = dlerror();
-            if (err || !func) {
-                throw std::runtime_error("Function '" + fn_name + "' not found (Error: " +
-                                        std::string(err ? err : "Unknown") + ")");
+    // 有意不析构: 避免退出时卸载仍有对象存活的库
+    static ZataSllRegistry& instance() {
+        static auto* registry = new ZataSllRegistry();
+        return *registry;
+    }
+
+    // 取得path中fn_name对应的函数, 第一次用到时加载库/解析符号, 之后直接返回缓存
+    ZataDllFunction resolve(const std::string& path, const std::string& fn_name) {
+        std::lock_guard lock(this->mutex_);
+        auto [lib_it, inserted] = this->libraries_.try_emplace(path);
+        Library& lib = lib_it->second;
+        if (inserted) {
+            try {
+                lib.handle = open_library(path);
+                attach_heap(lib.handle);
+            } catch (...) {
+                this->libraries_.erase(lib_it);
+                throw;
             }
-            #endif
-            functions[fn_name] = func;
         }
-    }
-    catch (...) {
-        // 释放句柄
-        if (handle) {
-        #ifdef _WIN32
-            FreeLibrary(reinterpret_cast<HMODULE>(handle));
-        #else
-            dlclose(handle);
-        #endif
+
+        auto fn_it = lib.functions.find(fn_name);
+        if (fn_it != lib.functions.end()) {
+            return fn_it->second;
         }
-        throw;
+        ZataDllFunction func = find_symbol(lib.handle, fn_name);
+        lib.functions.emplace(fn_name, func);
+        return func;
     }
+};
 
-    return ZataFunctionMap(handle, functions);
+// 模块的第fn_addr个导出函数, 解析结果缓存在module.sll_functions里
+// LOAD_SLL在命中缓存时只是一次下标访问
+inline ZataDllFunction resolve_sll_export(ZataModule& module, const int fn_addr) {
+    if (module.sll_functions.size() != module.exports.size()) {
+        module.sll_functions.assign(module.exports.size(), nullptr);
+    }
+    ZataDllFunction& slot = module.sll_functions.at(fn_addr);
+    if (!slot) {
+        slot = ZataSllRegistry::instance().resolve(module.module_path, module.exports[fn_addr]);
+    }
+    return slot;
 }
 
+// 预先加载模块的全部导出函数(可选), 之后执行LOAD_SLL不再触碰动态库
+inline void preload_sll(ZataModule& module) {
+    for (size_t i = 0; i < module.exports.size(); ++i) {
+        resolve_sll_export(module, static_cast<int>(i));
+    }
+}
@@ -1,9 +1,12 @@
 #ifndef UTILS_HPP
 #define UTILS_HPP
-#include <fstream>
+
+#ifdef _WIN32
 #include <windows.h>
+#endif
 
 #include "../models/Objects.hpp"
+#include "../builtins/builtins_type.hpp"
 
 
 namespace Utils {
@@ -21,29 +24,14 @@ namespace Utils {
         return result;
     }
 
-    inline auto read_zir(const std::string& filename) {
-        std::ifstream file(filename, std::ios::binary);
-
-        if (!file.is_open()) {
-            std::cerr << "failed to open file: " << filename << std::endl;
-            return std::vector<unsigned char>{};
-        }
-
-        file.seekg(0, std::ios::end);
-        const std::streamsize size = file.tellg();
-        file.seekg(0, std::ios::beg);
-
-        std::vector<unsigned char> buffer(size);
-
-        file.read(reinterpret_cast<char*>(buffer.data()), size);
-
-        if (!file) {
-            std::cerr << "Unknown error that we only read" << file.gcount() << "b, instead of" << size << " b" << std::endl;
-            return std::vector<unsigned char>{}; // 返回空vector表示错误
+    // 把虚拟机返回的值装箱成对象(交给Python等外部使用)
+    inline std::vector<ZataObjectPtr> values_to_objects(std::vector<ZataValue>&& values) {
+        std::vector<ZataObjectPtr> result;
+        result.reserve(values.size());
+        for (auto& value : values) {
+            result.push_back(box_value(std::move(value)));
         }
-
-        file.close();
-        return buffer;
+        return result;
     }
 
     inline void enable_ansi_escape() {
@@ -0,0 +1,567 @@
+#ifndef ZIR_FORMAT_HPP
+#define ZIR_FORMAT_HPP
+#include <bit>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <iterator>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "../models/Objects.hpp"
+#include "../builtins/builtins_type.hpp"
+#include "MappedFile.hpp"
+#include "../vm_deps/Bytecode.hpp"
+
+// .zir: 模块的二进制形式, 不经过Python就能直接加载执行(见zvm.cpp)
+// 所有整数为小端序, 各节的偏移都相对文件开头. 布局:
+//   头部      ZirHeader
+//   字符串表  每项 {u32 在字符串区中的偏移, u32 长度}
+//   字符串区  字符串的字节, 依次排列, 不带结尾的0
+//   对象表    每项 u32 对象记录的偏移; 记录为 u8 kind + 内容,
+//             对象之间用对象表下标互相引用(NO_REF表示空), 字符串用字符串表下标
+//   代码区    全部代码对象的co_code依次排列, 紧凑编码(见vm_deps/Bytecode.hpp)
+//   行号区    全部代码对象的line_map依次排列, 每项 {i32 行号, i32 指令位置}
+// 代码区与内存中的co_code编码相同, 从映射的文件加载时代码对象直接借用这段内存(见ZataCodeBuffer);
+// 对象表给出每条记录的位置, 加载分两遍: 先按kind创建全部对象, 再填写内容, 因此对象之间可以共享和成环
+namespace Zir {
+    static_assert(std::endian::native == std::endian::little, ".zir is little-endian");
+
+    constexpr char MAGIC[4] = {'Z', 'I', 'R', '\0'};
+    constexpr uint32_t VERSION = 3;
+    constexpr uint32_t NO_REF = 0xFFFFFFFF;
+
+    struct ZirHeader {
+        char magic[4];
+        uint32_t version;
+        uint32_t root;            // 模块对象的下标
+        uint32_t string_count;
+        uint32_t strings_offset;
+        uint32_t blob_offset;
+        uint32_t blob_size;
+        uint32_t object_count;
+        uint32_t objects_offset;
+        uint32_t code_offset;
+        uint32_t code_size;       // 字节数
+        uint32_t lines_offset;
+        uint32_t lines_count;     // 行号项的个数
+    };
+    static_assert(sizeof(ZirHeader) == 52);
+
+    // 能写进.zir的对象种类(常量池里出现的对象及模块本身)
+    inline bool serializable(const ZataKind kind) {
+        switch (kind) {
+            case ZataKind::CodeObject: case ZataKind::Module: case ZataKind::Function: case ZataKind::Class:
+            case ZataKind::String: case ZataKind::Int: case ZataKind::Int64:
+            case ZataKind::Float: case ZataKind::Float64: case ZataKind::State:
+                return true;
+            default:
+                return false;
+        }
+    }
+
+    class Writer {
+    public:
+        std::vector<unsigned char> write(ZataModule* module) {
+            const uint32_t root = this->collect(module);
+            // 对象记录先写进单独的缓冲区, 字符串在写记录时才登记
+            std::vector<uint32_t> record_offsets;
+            for (auto* obj : this->order) {
+                record_offsets.push_back(static_cast<uint32_t>(this->out.size()));
+                this->write_object(obj);
+            }
+            std::vector<unsigned char> records;
+            std::swap(records, this->out);
+
+            ZirHeader header{};
+            std::memcpy(header.magic, MAGIC, sizeof(MAGIC));
+            header.version = VERSION;
+            header.root = root;
+            this->out.resize(sizeof(ZirHeader));
+
+            header.string_count = static_cast<uint32_t>(this->strings.size());
+            header.strings_offset = this->here();
+            std::vector<unsigned char> blob;
+            for (const auto& str : this->strings) {
+                this->u32(static_cast<uint32_t>(blob.size()));
+                this->u32(static_cast<uint32_t>(str.size()));
+                blob.insert(blob.end(), str.begin(), str.end());
+            }
+            header.blob_offset = this->here();
+            header.blob_size = static_cast<uint32_t>(blob.size());
+            this->out.insert(this->out.end(), blob.begin(), blob.end());
+
+            this->align(4);
+            header.object_count = static_cast<uint32_t>(this->order.size());
+            header.objects_offset = this->here();
+            const uint32_t records_offset = header.objects_offset + header.object_count * 4;
+            for (const uint32_t offset : record_offsets) {
+                this->u32(records_offset + offset);
+            }
+            this->out.insert(this->out.end(), records.begin(), records.end());
+
+            header.code_offset = this->here();
+            header.code_size = static_cast<uint32_t>(this->code.size());
+            this->out.insert(this->out.end(), this->code.begin(), this->code.end());
+            this->align(4);
+            header.lines_offset = this->here();
+            header.lines_count = static_cast<uint32_t>(this->lines.size());
+            for (const auto& [line, pc] : this->lines) {
+                this->raw(static_cast<int32_t>(line));
+                this->raw(static_cast<int32_t>(pc));
+            }
+
+            std::memcpy(this->out.data(), &header, sizeof(ZirHeader));
+            return std::move(this->out);
+        }
+
+    private:
+        std::vector<unsigned char> out;
+        std::vector<ZataObject*> order;
+        std::unordered_map<const ZataObject*, uint32_t> indices;
+        std::vector<std::string> strings;
+        std::unordered_map<std::string, uint32_t> string_indices;
+        std::vector<uint8_t> code;
+        std::vector<std::pair<int, int>> lines;
+
+        [[nodiscard]] uint32_t here() const {
+            return static_cast<uint32_t>(this->out.size());
+        }
+
+        void align(const size_t alignment) {
+            this->out.resize((this->out.size() + alignment - 1) / alignment * alignment);
+        }
+
+        template <typename T>
+        void raw(const T& value) {
+            const auto* bytes = reinterpret_cast<const unsigned char*>(&value);
+            this->out.insert(this->out.end(), bytes, bytes + sizeof(T));
+        }
+
+        void u32(const uint32_t value) {
+            this->raw(value);
+        }
+
+        void str(const std::string& value) {
+            auto [it, inserted] = this->string_indices.try_emplace(value, static_cast<uint32_t>(this->strings.size()));
+            if (inserted) {
+                this->strings.push_back(value);
+            }
+            this->u32(it->second);
+        }
+
+        void ref(const ZataObject* obj) {
+            this->u32(obj ? this->indices.at(obj) : NO_REF);
+        }
+
+        void strs(const std::vector<std::string>& values) {
+            this->u32(static_cast<uint32_t>(values.size()));
+            for (const auto& value : values) {
+                this->str(value);
+            }
+        }
+
+        template <typename T>
+        void refs(const std::vector<T*>& values) {
+            this->u32(static_cast<uint32_t>(values.size()));
+            for (const auto* value : values) {
+                this->ref(value);
+            }
+        }
+
+        void attrs(const std::unordered_map<std::string, ZataObjectPtr>& values) {
+            this->u32(static_cast<uint32_t>(values.size()));
+            for (const auto& [name, value] : values) {
+                this->str(name);
+                this->ref(value);
+            }
+        }
+
+        // 从模块出发按深度优先给可达对象编号
+        uint32_t collect(ZataObject* root) {
+            std::vector<ZataObject*> pending{root};
+            while (!pending.empty()) {
+                auto* obj = pending.back();
+                pending.pop_back();
+                if (!obj || this->indices.contains(obj)) {
+                    continue;
+                }
+                if (!serializable(obj->kind)) {
+                    throw std::runtime_error("zir: cannot serialize object of kind " +
+                                             std::to_string(static_cast<int>(obj->kind)));
+                }
+                this->indices.emplace(obj, static_cast<uint32_t>(this->order.size()));
+                this->order.push_back(obj);
+                switch (obj->kind) {
+                    case ZataKind::CodeObject: {
+                        const auto& code = static_cast<ZataCodeObject&>(*obj);
+                        pending.insert(pending.end(), code.consts.begin(), code.consts.end());
+                        pending.insert(pending.end(), code.locals.begin(), code.locals.end());
+                        break;
+                    }
+                    case ZataKind::Module: {
+                        const auto& module = static_cast<ZataModule&>(*obj);
+                        pending.push_back(module.code);
+                        for (const auto& [name, attr] : module.attrs) {
+                            pending.push_back(attr);
+                        }
+                        break;
+                    }
+                    case ZataKind::Function:
+                        pending.push_back(static_cast<ZataFunction&>(*obj).code);
+                        break;
+                    case ZataKind::Class: {
+                        const auto& class_obj = static_cast<ZataClass&>(*obj);
+                        pending.insert(pending.end(), class_obj.parent_class.begin(), class_obj.parent_class.end());
+                        for (const auto& [name, attr] : class_obj.attrs) {
+                            pending.push_back(attr);
+                        }
+                        break;
+                    }
+                    default:
+                        break;
+                }
+            }
+            return this->indices.at(root);
+        }
+
+        void write_object(ZataObject* obj) {
+            this->out.push_back(static_cast<unsigned char>(obj->kind));
+            switch (obj->kind) {
+                case ZataKind::CodeObject: {
+                    const auto& code = static_cast<ZataCodeObject&>(*obj);
+                    this->refs(code.consts);
+                    this->refs(code.locals);
+                    this->raw(static_cast<int32_t>(code.max_stack));
+                    this->u32(static_cast<uint32_t>(this->code.size()));
+                    this->u32(static_cast<uint32_t>(code.co_code.size()));
+                    this->code.insert(this->code.end(), code.co_code.data(), code.co_code.data() + code.co_code.size());
+                    this->u32(static_cast<uint32_t>(this->lines.size()));
+                    this->u32(static_cast<uint32_t>(code.line_map.size()));
+                    this->lines.insert(this->lines.end(), code.line_map.begin(), code.line_map.end());
+                    break;
+                }
+                case ZataKind::Module: {
+                    const auto& module = static_cast<ZataModule&>(*obj);
+                    this->str(module.object_name);
+                    this->str(module.module_path);
+                    this->raw(static_cast<uint64_t>(module.global_count));
+                    this->strs(module.names);
+                    this->attrs(module.attrs);
+                    this->ref(module.code);
+                    this->strs(module.exports);
+                    break;
+                }
+                case ZataKind::Function: {
+                    const auto& function = static_cast<ZataFunction&>(*obj);
+                    this->str(function.object_name);
+                    this->raw(static_cast<int32_t>(function.arg_count));
+                    this->ref(function.code);
+                    this->strs(function.free_vars_names);
+                    break;
+                }
+                case ZataKind::Class: {
+                    const auto& class_obj = static_cast<ZataClass&>(*obj);
+                    this->str(class_obj.object_name);
+                    this->refs(class_obj.parent_class);
+                    this->strs(class_obj.names);
+                    this->attrs(class_obj.attrs);
+                    break;
+                }
+                case ZataKind::String:
+                    this->str(static_cast<ZataString&>(*obj).val);
+                    break;
+                case ZataKind::Int:
+                    this->raw(static_cast<int32_t>(static_cast<ZataInt&>(*obj).val));
+                    break;
+                case ZataKind::Int64:
+                    this->raw(static_cast<int64_t>(static_cast<ZataInt64&>(*obj).val));
+                    break;
+                case ZataKind::Float:
+                    this->raw(static_cast<ZataFloat&>(*obj).val);
+                    break;
+                case ZataKind::Float64:
+                    this->raw(static_cast<ZataFloat64&>(*obj).val);
+                    break;
+                case ZataKind::State:
+                    this->raw(static_cast<int32_t>(static_cast<ZataState&>(*obj).val));
+                    break;
+                default:
+                    break;
+            }
+        }
+    };
+
+    // 加载期间不经过安全点, 新建的对象不会被回收; 返回的模块由调用方负责固定或交给虚拟机
+    // owner持有data所在的内存, 代码对象借用代码区时各自保留一份
+    class Reader {
+    public:
+        Reader(const unsigned char* data, const size_t size, std::shared_ptr<const void> owner)
+            : data(data), size(size), owner(std::move(owner)) {}
+
+        ZataModule* read() {
+            if (this->size < sizeof(ZirHeader)) {
+                throw std::runtime_error("zir: file too short");
+            }
+            std::memcpy(&this->header, this->data, sizeof(ZirHeader));
+            if (std::memcmp(this->header.magic, MAGIC, sizeof(MAGIC)) != 0) {
+                throw std::runtime_error("zir: bad magic");
+            }
+            if (this->header.version != VERSION) {
+                throw std::runtime_error("zir: unsupported version " + std::to_string(this->header.version));
+            }
+            this->check_section(this->header.strings_offset, this->header.string_count, 8);
+            this->check_section(this->header.blob_offset, this->header.blob_size, 1);
+            this->check_section(this->header.objects_offset, this->header.object_count, 4);
+            this->check_section(this->header.code_offset, this->header.code_size, 1);
+            this->check_section(this->header.lines_offset, this->header.lines_count, 8);
+
+            // 字符串只在需要时才拷贝成std::string(字段名, 字符串常量等)
+            this->strings.reserve(this->header.string_count);
+            this->pos = this->header.strings_offset;
+            for (uint32_t i = 0; i < this->header.string_count; ++i) {
+                const uint32_t offset = this->u32();
+                const uint32_t length = this->u32();
+                if (offset > this->header.blob_size || length > this->header.blob_size - offset) {
+                    throw std::runtime_error("zir: string out of range");
+                }
+                this->strings.emplace_back(reinterpret_cast<const char*>(this->data + this->header.blob_offset + offset), length);
+            }
+
+            // 第一遍: 按kind创建对象(标量对象在这一遍就完成)
+            std::vector<uint32_t> offsets(this->header.object_count);
+            this->pos = this->header.objects_offset;
+            for (auto& offset : offsets) {
+                offset = this->u32();
+            }
+            this->objects.reserve(offsets.size());
+            for (const uint32_t offset : offsets) {
+                this->seek(offset);
+                this->objects.push_back(this->create(static_cast<ZataKind>(this->u8())));
+            }
+
+            // 第二遍: 填写容器对象的内容
+            for (size_t i = 0; i < offsets.size(); ++i) {
+                this->seek(offsets[i] + 1);
+                this->fill(this->objects[i]);
+            }
+
+            auto* module = zata_cast<ZataModule>(this->object(this->header.root));
+            if (!module) {
+                throw std::runtime_error("zir: root object is not a module");
+            }
+            return module;
+        }
+
+    private:
+        const unsigned char* data;
+        size_t size;
+        std::shared_ptr<const void> owner;
+        ZirHeader header{};
+        size_t pos = 0;
+        std::vector<std::string_view> strings;
+        std::vector<ZataObject*> objects;
+
+        void check_section(const size_t offset, const size_t count, const size_t width) const {
+            if (offset > this->size || count > (this->size - offset) / width) {
+                throw std::runtime_error("zir: section out of range");
+            }
+        }
+
+        void seek(const size_t offset) {
+            if (offset > this->size) {
+                throw std::runtime_error("zir: object record out of range");
+            }
+            this->pos = offset;
+        }
+
+        void need(const size_t count) const {
+            if (count > this->size - this->pos) {
+                throw std::runtime_error("zir: unexpected end of file");
+            }
+        }
+
+        template <typename T>
+        T raw() {
+            this->need(sizeof(T));
+            T value;
+            std::memcpy(&value, this->data + this->pos, sizeof(T));
+            this->pos += sizeof(T);
+            return value;
+        }
+
+        uint8_t u8() {
+            return this->raw<uint8_t>();
+        }
+
+        uint32_t u32() {
+            return this->raw<uint32_t>();
+        }
+
+        std::string_view str() {
+            const uint32_t index = this->u32();
+            if (index >= this->strings.size()) {
+                throw std::runtime_error("zir: string index out of range");
+            }
+            return this->strings[index];
+        }
+
+        ZataObject* object(const uint32_t index) const {
+            if (index == NO_REF) {
+                return nullptr;
+            }
+            if (index >= this->objects.size()) {
+                throw std::runtime_error("zir: object index out of range");
+            }
+            return this->objects[index];
+        }
+
+        template <typename T>
+        T* ref() {
+            auto* obj = this->object(this->u32());
+            if constexpr (std::is_same_v<T, ZataObject>) {
+                return obj;
+            } else {
+                auto* result = zata_cast<T>(obj);
+                if (obj && !result) {
+                    throw std::runtime_error("zir: object reference has the wrong kind");
+                }
+                return result;
+            }
+        }
+
+        std::vector<std::string> strs() {
+            std::vector<std::string> result(this->u32());
+            for (auto& value : result) {
+                value = std::string(this->str());
+            }
+            return result;
+        }
+
+        template <typename T>
+        std::vector<T*> refs() {
+            std::vector<T*> result(this->u32());
+            for (auto& value : result) {
+                value = this->ref<T>();
+            }
+            return result;
+        }
+
+        std::unordered_map<std::string, ZataObjectPtr> attrs() {
+            std::unordered_map<std::string, ZataObjectPtr> result;
+            const uint32_t count = this->u32();
+            for (uint32_t i = 0; i < count; ++i) {
+                const std::string_view name = this->str();
+                result[std::string(name)] = this->ref<ZataObject>();
+            }
+            return result;
+        }
+
+        // 容器对象先建空的, 标量对象直接读出值(小整数等会拿到缓存的不朽对象)
+        ZataObject* create(const ZataKind kind) {
+            switch (kind) {
+                case ZataKind::CodeObject: return new ZataCodeObject();
+                case ZataKind::Module: return new ZataModule();
+                case ZataKind::Function: return new ZataFunction();
+                case ZataKind::Class: return new ZataClass();
+                case ZataKind::String: return create_str(std::string(this->str()));
+                case ZataKind::Int: return create_int(this->raw<int32_t>());
+                case ZataKind::Int64: return create_int64(this->raw<int64_t>());
+                case ZataKind::Float: return create_float(this->raw<float>());
+                case ZataKind::Float64: return create_float64(this->raw<double>());
+                case ZataKind::State: return create_state(this->raw<int32_t>());
+                default:
+                    throw std::runtime_error("zir: unknown object kind " + std::to_string(static_cast<int>(kind)));
+            }
+        }
+
+        void fill(ZataObject* obj) {
+            switch (obj->kind) {
+                case ZataKind::CodeObject: {
+                    auto& code = static_cast<ZataCodeObject&>(*obj);
+                    code.consts = this->refs<ZataObject>();
+                    code.locals = this->refs<ZataObject>();
+                    code.max_stack = this->raw<int32_t>();
+                    const uint32_t code_begin = this->u32();
+                    const uint32_t code_size = this->u32();
+                    if (code_begin > this->header.code_size || code_size > this->header.code_size - code_begin) {
+                        throw std::runtime_error("zir: code out of range");
+                    }
+                    // 这里只扫描一遍校验编码并得到slot数, 解码推迟到第一次执行
+                    const uint8_t* code_bytes = this->data + this->header.code_offset + code_begin;
+                    code.co_code.borrow(code_bytes, code_size, bytecode_slots(code_bytes, code_size), this->owner);
+
+                    const uint32_t line_begin = this->u32();
+                    const uint32_t line_count = this->u32();
+                    if (line_begin > this->header.lines_count || line_count > this->header.lines_count - line_begin) {
+                        throw std::runtime_error("zir: line map out of range");
+                    }
+                    const size_t saved = this->pos;
+                    this->pos = this->header.lines_offset + static_cast<size_t>(line_begin) * 8;
+                    code.line_map.resize(line_count);
+                    for (auto& [line, pc] : code.line_map) {
+                        line = this->raw<int32_t>();
+                        pc = this->raw<int32_t>();
+                    }
+                    this->pos = saved;
+                    break;
+                }
+                case ZataKind::Module: {
+                    auto& module = static_cast<ZataModule&>(*obj);
+                    module.object_name = this->str();
+                    module.module_path = this->str();
+                    module.global_count = static_cast<size_t>(this->raw<uint64_t>());
+                    module.names = this->strs();
+                    module.attrs = this->attrs();
+                    module.code = this->ref<ZataCodeObject>();
+                    module.exports = this->strs();
+                    break;
+                }
+                case ZataKind::Function: {
+                    auto& function = static_cast<ZataFunction&>(*obj);
+                    function.object_name = this->str();
+                    function.arg_count = this->raw<int32_t>();
+                    function.code = this->ref<ZataCodeObject>();
+                    function.free_vars_names = this->strs();
+                    break;
+                }
+                case ZataKind::Class: {
+                    auto& class_obj = static_cast<ZataClass&>(*obj);
+                    class_obj.object_name = this->str();
+                    class_obj.parent_class = this->refs<ZataClass>();
+                    class_obj.names = this->strs();
+                    class_obj.attrs = this->attrs();
+                    break;
+                }
+                default:
+                    break;
+            }
+        }
+    };
+
+    inline std::vector<unsigned char> dump(ZataModule* module) {
+        return Writer().write(module);
+    }
+
+    // 从映射的文件加载, 代码对象直接使用文件中的代码区
+    inline ZataModule* load(const std::shared_ptr<const ZataMappedFile>& file) {
+        return Reader(file->data(), file->size(), file).read();
+    }
+
+    inline ZataModule* load_file(const std::string& path) {
+        return load(ZataMappedFile::open(path));
+    }
+
+    // 从内存中的字节加载(拷贝一份, 代码对象借用这份拷贝)
+    inline ZataModule* load(const std::vector<unsigned char>& buffer) {
+        const auto copy = std::make_shared<const std::vector<unsigned char>>(buffer);
+        return Reader(copy->data(), copy->size(), copy).read();
+    }
+}
+
+#endif //ZIR_FORMAT_HPP
@@ -0,0 +1,122 @@
+#ifndef BYTECODE_HPP
+#define BYTECODE_HPP
+#include <algorithm>
+#include <cstdint>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "models/Objects.hpp"
+#include "vm_deps/ZvmOpcodes.hpp"
+
+// co_code的紧凑编码
+// 前端和Python侧使用的是int数组(每个opcode和操作数各占一个int), 代码对象里存放的是它的紧凑形式:
+//   指令 = [EXTENDED_ARG]* opcode(1字节) 操作数*(每个 1 + 前缀个数 字节, 小端序)
+// 没有前缀时操作数只占1字节; 每个EXTENDED_ARG前缀让这条指令的每个操作数多占1字节, 最多3个(4字节)
+// 跳转偏移(Opcode::signed_operand)按有符号数扩展, 其余操作数按无符号数扩展, 因此任意int都能原样往返
+// 位置不因编码改变: 跳转偏移和line_map仍以int数组中的下标(slot)为单位
+// 虚拟机执行前由紧凑编码直接生成每slot一个的线索化单元(见vm_deps/Dispatch.hpp), 分发循环本身不需要处理变长指令
+
+constexpr int ZATA_MAX_OPERAND_BYTES = 4;
+
+// 操作数需要的字节数
+inline int bytecode_operand_width(const int opcode, const int value) {
+    if (Opcode::signed_operand(opcode)) {
+        if (value >= INT8_MIN && value <= INT8_MAX) return 1;
+        if (value >= INT16_MIN && value <= INT16_MAX) return 2;
+        if (value >= -(1 << 23) && value < (1 << 23)) return 3;
+        return 4;
+    }
+    const auto bits = static_cast<uint32_t>(value);
+    if (bits <= 0xFF) return 1;
+    if (bits <= 0xFFFF) return 2;
+    if (bits <= 0xFFFFFF) return 3;
+    return 4;
+}
+
+// int数组 -> 紧凑编码
+inline ZataCodeBuffer encode_bytecode(const std::vector<int>& code) {
+    std::vector<uint8_t> bytes;
+    bytes.reserve(code.size() + code.size() / 4);
+    size_t pc = 0;
+    while (pc < code.size()) {
+        const int opcode = code[pc];
+        if (opcode < 0 || opcode > 0xFF || opcode == Opcode::EXTENDED_ARG) {
+            throw std::runtime_error("bytecode: invalid opcode " + std::to_string(opcode) +
+                                     " at " + std::to_string(pc));
+        }
+        const int operands = Opcode::operand_count(opcode);
+        if (pc + operands >= code.size()) {
+            throw std::runtime_error("bytecode: truncated instruction at " + std::to_string(pc));
+        }
+        int width = 1;
+        for (int i = 1; i <= operands; ++i) {
+            width = std::max(width, bytecode_operand_width(opcode, code[pc + i]));
+        }
+        bytes.insert(bytes.end(), width - 1, static_cast<uint8_t>(Opcode::EXTENDED_ARG));
+        bytes.push_back(static_cast<uint8_t>(opcode));
+        for (int i = 1; i <= operands; ++i) {
+            const auto bits = static_cast<uint32_t>(code[pc + i]);
+            for (int b = 0; b < width; ++b) {
+                bytes.push_back(static_cast<uint8_t>(bits >> (8 * b)));
+            }
+        }
+        pc += 1 + operands;
+    }
+    return {std::move(bytes), code.size()};
+}
+
+// 逐条解析紧凑编码, 对每条指令调用visit(pc, opcode, operands, operand_count), 返回解码后的slot数
+// 编码不完整时抛出异常(文件里的代码可能已损坏)
+template <typename Visit>
+size_t walk_bytecode(const uint8_t* bytes, const size_t size, Visit&& visit) {
+    size_t pos = 0;
+    size_t pc = 0;
+    int operands[Opcode::MAX_OPERANDS];
+    while (pos < size) {
+        int width = 1;
+        while (bytes[pos] == Opcode::EXTENDED_ARG) {
+            width += 1;
+            if (width > ZATA_MAX_OPERAND_BYTES || ++pos >= size) {
+                throw std::runtime_error("bytecode: malformed EXTENDED_ARG prefix");
+            }
+        }
+        const int opcode = bytes[pos++];
+        const int count = Opcode::operand_count(opcode);
+        if (static_cast<size_t>(count) * width > size - pos) {
+            throw std::runtime_error("bytecode: truncated instruction");
+        }
+        for (int i = 0; i < count; ++i) {
+            uint32_t bits = 0;
+            for (int b = 0; b < width; ++b) {
+                bits |= static_cast<uint32_t>(bytes[pos++]) << (8 * b);
+            }
+            // 有符号操作数从最高字节符号扩展
+            if (Opcode::signed_operand(opcode) && width < 4 && (bits >> (8 * width - 1)) & 1) {
+                bits |= ~0u << (8 * width);
+            }
+            operands[i] = static_cast<int>(bits);
+        }
+        visit(pc, opcode, operands, count);
+        pc += 1 + count;
+    }
+    return pc;
+}
+
+// 只校验并计算slot数, 不生成数组
+inline size_t bytecode_slots(const uint8_t* bytes, const size_t size) {
+    return walk_bytecode(bytes, size, [](size_t, int, const int*, int) {});
+}
+
+// 紧凑编码 -> int数组
+inline std::vector<int> decode_bytecode(const ZataCodeBuffer& code) {
+    std::vector<int> result;
+    result.reserve(code.slots());
+    walk_bytecode(code.data(), code.size(), [&result](size_t, const int opcode, const int* operands, const int count) {
+        result.push_back(opcode);
+        result.insert(result.end(), operands, operands + count);
+    });
+    return result;
+}
+
+#endif //BYTECODE_HPP
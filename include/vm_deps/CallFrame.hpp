@@ -1,17 +1,30 @@
 #ifndef CALL_FRAME_HPP
 #define CALL_FRAME_HPP
-#include <string>
+#include <deque>
+#include <stack>
+#include <string_view>
 
 #include "models/Objects.hpp"
 
 // 调用帧
+// 局部变量不在帧里, 而是位于虚拟机value_stack上从locals_base开始的窗口
 struct CallFrame {
-    int pc = 0;
-    std::vector<ZataObjectPtr> locals;
     int return_address = 0;
-    std::string name;
-    std::shared_ptr<ZataCodeObject> code_object;
+    size_t locals_base = 0;
+    std::string_view name;
+    ZataCodeObject* code_object = nullptr;
+    ZataObjectPtr owner = nullptr;  // 回收时作为根, 保证帧执行期间函数/代码对象存活
 };
 
+// std::stack不提供遍历, 回收器枚举根时借派生类访问它底层的容器
+inline const std::deque<CallFrame>& call_frames(const std::stack<CallFrame>& stack) {
+    struct Access : std::stack<CallFrame> {
+        static const container_type& frames(const std::stack<CallFrame>& s) {
+            return s.*&Access::c;
+        }
+    };
+    return Access::frames(stack);
+}
+
 
 #endif //CALL_FRAME_HPP
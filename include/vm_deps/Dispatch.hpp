@@ -0,0 +1,68 @@
+#ifndef DISPATCH_HPP
+#define DISPATCH_HPP
+#include <cstdint>
+#include <vector>
+
+#include "models/Objects.hpp"
+#include "vm_deps/Bytecode.hpp"
+#include "vm_deps/ZvmOpcodes.hpp"
+
+// 分发方式(编译期选择):
+// ZVM_COMPUTED_GOTO=1 -> 直接线索化(computed goto, 需要GCC/Clang的 &&label 扩展)
+// ZVM_COMPUTED_GOTO=0 -> switch (可移植的后备实现)
+#ifndef ZVM_COMPUTED_GOTO
+#if defined(__GNUC__) || defined(__clang__)
+#define ZVM_COMPUTED_GOTO 1
+#else
+#define ZVM_COMPUTED_GOTO 0
+#endif
+#endif
+
+// 处理程序在单元里存成相对于base(分发循环中的op_UNKNOWN)的偏移, 单元因此只有8字节而不是16字节
+// 同一个函数里的标签彼此相距远小于2GB, 偏移总能放进int32
+inline int32_t dispatch_offset(const void* handler, const void* base) {
+    return static_cast<int32_t>(static_cast<const char*>(handler) - static_cast<const char*>(base));
+}
+
+// 由要执行的指令流(co_code或优化后的optimized_code)的紧凑编码直接生成线索化单元, 不经过中间的int数组
+// 每个ZataCodeObject只做一次(结果缓存在threaded_code里), 两种分发方式执行的都是这一份
+// 每个位置都同时记录 "按指令解释时的处理程序" 和 "按操作数解释时的值",
+// 这样即使跳转落在操作数上, 行为也和switch版本一致
+// 末尾额外放一个哨兵单元(处理程序为end_handler, 值为HALT), 主循环因此不再需要检查pc是否越界
+// dispatch_table为空时(switch分发)只填operand, 快速化改写operand; 线索化时快速化只改写handler, operand保持原始值
+inline std::vector<ZataThreadedCell>& build_threaded_code(
+    ZataCodeObject& code_object,
+    const void* const* dispatch_table,
+    const void* unknown_handler,
+    const void* end_handler)
+{
+    if (!code_object.threaded_code.empty()) {
+        return code_object.threaded_code;
+    }
+
+    const ZataCodeBuffer& code = code_object.exec_code();
+    std::vector<ZataThreadedCell> stream(code.slots() + 1);
+    auto emit = [&stream, dispatch_table, unknown_handler](const size_t pc, const int value) {
+        stream[pc].operand = value;
+        if (dispatch_table) {
+            stream[pc].handler = dispatch_offset(
+                (value >= 0 && value < 256) ? dispatch_table[value] : unknown_handler, unknown_handler);
+        }
+    };
+    walk_bytecode(code.data(), code.size(), [&emit](const size_t pc, const int opcode, const int* operands, const int count) {
+        emit(pc, opcode);
+        for (int i = 0; i < count; ++i) {
+            emit(pc + 1 + i, operands[i]);
+        }
+    });
+    stream.back().operand = Opcode::HALT;
+    if (dispatch_table) {
+        stream.back().handler = dispatch_offset(end_handler, unknown_handler);
+    }
+
+    code_object.threaded_code = std::move(stream);
+    code_object.quick_counters.assign(code.slots(), 0);
+    return code_object.threaded_code;
+}
+
+#endif //DISPATCH_HPP
@@ -0,0 +1,85 @@
+#ifndef LINKER_HPP
+#define LINKER_HPP
+#include <unordered_set>
+
+#include "models/Objects.hpp"
+#include "vm_deps/Optimizer.hpp"
+#include "vm_deps/Verifier.hpp"
+#include "vm_deps/VmModels.hpp"
+
+// 链接: 模块加载时把常量池里的函数对象标记为 "内置" 或 "字节码"
+// 内置函数直接记下BuiltinsTable中的入口, CALL因此不需要再按名字查表
+// 字节码函数的代码在这里优化并校验(见vm_deps/Optimizer.hpp, vm_deps/Verifier.hpp), 校验不通过时抛出异常, 模块不会开始执行
+
+// 代码对象第一次链接/执行前先做窥孔优化再校验, 之后只按使用场景检查
+inline void prepare_code(ZataCodeObject& code_object, const ZataVerifyContext& context) {
+#if ZVM_OPTIMIZE
+    if (!code_object.verified) {
+        optimize_code(code_object);
+    }
+#endif
+    verify_code(code_object, context);
+}
+
+inline void link_function(ZataFunction& function, const size_t global_count) {
+    function.builtin_index = find_builtin(function.object_name);
+    function.native = function.builtin_index >= 0 ? BuiltinsTable[function.builtin_index].function : nullptr;
+    if (!function.native && function.code) {
+        prepare_code(*function.code, ZataVerifyContext{
+            .global_count = global_count,
+            .arg_count = function.arg_count,
+            .returns_value = true,
+        });
+    }
+    function.linked = true;
+    function.linked_globals = global_count;
+}
+
+// 函数是否已按global_count链接并校验过
+// 代码对象被改写时verified会被清除, 同一个函数对象交给全局变量个数不同的虚拟机时也要重新校验
+inline bool function_linked(const ZataFunction& function, const size_t global_count) {
+    return function.linked && function.linked_globals == global_count &&
+           (!function.code || function.code->verified);
+}
+
+// 递归链接code_object常量池中的函数/类/模块, visited防止函数引用自身时无限递归
+// global_count为执行它们的虚拟机的全局变量个数(所有代码共用同一组全局变量)
+inline void link_code(ZataCodeObject& code_object, const size_t global_count,
+                      std::unordered_set<const ZataObject*>& visited) {
+    if (!visited.insert(&code_object).second) {
+        return;
+    }
+    for (const auto& obj : code_object.consts) {
+        if (auto* function = zata_cast<ZataFunction>(obj)) {
+            link_function(*function, global_count);
+            if (function->code) {
+                link_code(*function->code, global_count, visited);
+            }
+        } else if (auto* module = zata_cast<ZataModule>(obj)) {
+            if (module->code) {
+                link_code(*module->code, global_count, visited);
+            }
+        } else if (auto* class_obj = zata_cast<ZataClass>(obj)) {
+            for (const auto& [name, attr] : class_obj->attrs) {
+                auto* method = zata_cast<ZataFunction>(attr);
+                if (method) {
+                    link_function(*method, global_count);
+                    if (method->code) {
+                        link_code(*method->code, global_count, visited);
+                    }
+                }
+            }
+        }
+    }
+}
+
+inline void link_module(ZataModule& module) {
+    if (!module.code) {
+        return;
+    }
+    prepare_code(*module.code, ZataVerifyContext{.global_count = module.global_count});
+    std::unordered_set<const ZataObject*> visited;
+    link_code(*module.code, module.global_count, visited);
+}
+
+#endif //LINKER_HPP
@@ -0,0 +1,143 @@
+#ifndef OPERAND_STACK_HPP
+#define OPERAND_STACK_HPP
+#include <memory>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+#include "models/Objects.hpp"
+#include "models/ZataValue.hpp"
+#include "vm_deps/Bytecode.hpp"
+#include "vm_deps/ZvmOpcodes.hpp"
+
+// ZVM_STACK_CHECKS=1 时push/pop/top会检查越界, 否则不做任何检查(release默认)
+#ifndef ZVM_STACK_CHECKS
+#ifdef NDEBUG
+#define ZVM_STACK_CHECKS 0
+#else
+#define ZVM_STACK_CHECKS 1
+#endif
+#endif
+
+// 操作数栈: 连续数组 + 栈顶指针
+// 容量在进入帧时按ZataCodeObject::max_stack预留(reserve), 之后的push不再检查容量
+class ZataOperandStack {
+private:
+    std::unique_ptr<ZataValue[]> slots;
+    ZataValue* sp = nullptr;    // 指向下一个空槽位
+    size_t capacity = 0;
+
+    void check_push() const {
+    #if ZVM_STACK_CHECKS
+        if (this->size() >= this->capacity) {
+            throw std::runtime_error("operand stack overflow (max_stack too small)");
+        }
+    #endif
+    }
+
+    void check_pop() const {
+    #if ZVM_STACK_CHECKS
+        if (this->empty()) {
+            throw std::runtime_error("operand stack underflow");
+        }
+    #endif
+    }
+
+public:
+    ZataOperandStack() = default;
+    ZataOperandStack(const ZataOperandStack&) = delete;
+    ZataOperandStack& operator=(const ZataOperandStack&) = delete;
+
+    // 保证至少还能再压入extra个值, 只在进入帧时调用
+    void reserve(const size_t extra) {
+        const size_t used = this->size();
+        if (used + extra <= this->capacity) {
+            return;
+        }
+
+        size_t new_capacity = this->capacity ? this->capacity : 64;
+        while (new_capacity < used + extra) {
+            new_capacity *= 2;
+        }
+
+        auto new_slots = std::make_unique<ZataValue[]>(new_capacity);
+        std::move(this->slots.get(), this->sp, new_slots.get());
+        this->slots = std::move(new_slots);
+        this->sp = this->slots.get() + used;
+        this->capacity = new_capacity;
+    }
+
+    [[nodiscard]] size_t size() const { return this->sp - this->slots.get(); }
+    [[nodiscard]] bool empty() const { return this->sp == this->slots.get(); }
+
+    ZataValue& top() {
+        this->check_pop();
+        return this->sp[-1];
+    }
+
+    // 栈顶往下第depth个值(0为栈顶), 不弹出
+    ZataValue& peek(const size_t depth) {
+    #if ZVM_STACK_CHECKS
+        if (depth >= this->size()) {
+            throw std::runtime_error("operand stack underflow");
+        }
+    #endif
+        return this->sp[-1 - static_cast<ptrdiff_t>(depth)];
+    }
+
+    void push(const ZataValue& value) {
+        this->check_push();
+        *this->sp++ = value;
+    }
+
+    void push(ZataValue&& value) {
+        this->check_push();
+        *this->sp++ = std::move(value);
+    }
+
+    void pop() {
+        this->check_pop();
+        --this->sp;
+    }
+
+    // 弹出栈顶并把值交给调用方
+    ZataValue take() {
+        this->check_pop();
+        return *--this->sp;
+    }
+
+    // 从栈底到栈顶遍历(回收器枚举根时使用), 栈顶以上的旧值不算根
+    [[nodiscard]] const ZataValue* begin() const { return this->slots.get(); }
+    [[nodiscard]] const ZataValue* end() const { return this->sp; }
+
+    // 按从栈底到栈顶的顺序把所有值移出, 栈被清空
+    std::vector<ZataValue> release() {
+        std::vector<ZataValue> result;
+        result.reserve(this->size());
+        for (ZataValue* it = this->slots.get(); it != this->sp; ++it) {
+            result.push_back(std::move(*it));
+        }
+        this->sp = this->slots.get();
+        return result;
+    }
+};
+
+// 帧需要的操作数栈深度
+// 校验过的代码使用校验得出的深度(前端给出的max_stack只作参考); 否则前端没有给出max_stack时, 用指令条数作上界(每条指令最多净压入一个值), 结果缓存在estimated_stack
+inline size_t code_max_stack(ZataCodeObject& code_object) {
+    if (code_object.verified) {
+        return static_cast<size_t>(code_object.verified_stack);
+    }
+    if (code_object.max_stack > 0) {
+        return static_cast<size_t>(code_object.max_stack);
+    }
+    if (code_object.estimated_stack <= 0) {
+        int instructions = 0;
+        walk_bytecode(code_object.exec_code().data(), code_object.exec_code().size(),
+                      [&instructions](size_t, int, const int*, int) { instructions += 1; });
+        code_object.estimated_stack = instructions + 1;
+    }
+    return static_cast<size_t>(code_object.estimated_stack);
+}
+
+#endif //OPERAND_STACK_HPP
@@ -0,0 +1,336 @@
+#ifndef OPTIMIZER_HPP
+#define OPTIMIZER_HPP
+#include <algorithm>
+#include <exception>
+#include <initializer_list>
+#include <utility>
+#include <vector>
+
+#include "builtins/builtins_type.hpp"
+#include "models/Objects.hpp"
+#include "vm_deps/Bytecode.hpp"
+#include "vm_deps/Verifier.hpp"
+#include "vm_deps/ZvmOpcodes.hpp"
+
+// 窥孔优化: 代码对象第一次链接时(校验之前)由co_code生成优化后的指令流, 前端不需要做任何优化
+// 结果放在代码对象的虚拟机缓存里(optimized_code/folded_consts), co_code/consts/line_map不变:
+// 借用映射文件的co_code不会被复制, save_zir写出的仍是原来的代码, 反复invalidate后重新优化也不会让常量池变长
+//   常量折叠    LOAD_CONST a; LOAD_CONST b; B_CALC op  ->  LOAD_CONST (a op b), 结果放在folded_consts
+//              只折叠value_binary能算的立即数运算, 结果与虚拟机执行时完全相同(除零等情况留到运行时报错)
+//   删除        NOP, 以及 LOAD_CONST/LOAD_LOCAL/LOAD_GLOBAL/DUP 紧跟 POP
+//   跳转穿透    跳转的目标是JMP时直接跳到最终目标; JMP到下一条指令时删除
+//   死代码      从入口不可达的指令(JMP/RET/HALT之后没有跳转进入的部分)
+//   超级指令    最后把常见的指令序列合并成一条(见ZvmOpcodes.hpp中的LOAD_LOCAL2等), 减少分发次数
+// 跳转偏移按新的位置重写. 遇到不认识的指令或非法跳转时不做任何改动, 交给校验器报错
+// 向后的JMP是安全点, 跳转穿透不会让循环失去它: 向后的JMP保持向后, 条件跳转不会变成向后跳转
+
+// ZVM_OPTIMIZE=0 时关闭(例如对照前端输出调试时)
+#ifndef ZVM_OPTIMIZE
+#define ZVM_OPTIMIZE 1
+#endif
+
+struct ZataPeepholeInstruction {
+    int opcode;
+    int operands[Opcode::MAX_OPERANDS];
+    int count;
+    size_t target;   // 跳转目标的指令序号, 等于指令条数时表示末尾; 只对跳转指令有效
+    size_t origin;   // 在原co_code中的位置
+    bool removed;
+};
+
+// 删除标记为removed的指令, 指向它们的跳转顺延到其后第一条保留的指令
+inline void peephole_compact(std::vector<ZataPeepholeInstruction>& code) {
+    std::vector<size_t> remap(code.size() + 1);
+    size_t kept = 0;
+    for (size_t i = 0; i < code.size(); ++i) {
+        remap[i] = kept;
+        if (!code[i].removed) {
+            kept += 1;
+        }
+    }
+    remap[code.size()] = kept;
+
+    std::vector<ZataPeepholeInstruction> result;
+    result.reserve(kept);
+    for (auto& instruction : code) {
+        if (instruction.removed) {
+            continue;
+        }
+        if (Opcode::is_jump(instruction.opcode)) {
+            instruction.target = remap[instruction.target];
+        }
+        result.push_back(instruction);
+    }
+    code = std::move(result);
+}
+
+// 每个位置是否为跳转目标
+inline std::vector<bool> peephole_labels(const std::vector<ZataPeepholeInstruction>& code) {
+    std::vector<bool> labels(code.size() + 1, false);
+    for (const auto& instruction : code) {
+        if (Opcode::is_jump(instruction.opcode)) {
+            labels[instruction.target] = true;
+        }
+    }
+    return labels;
+}
+
+// 折叠出的常量追加到folded, 下标接在code_object.consts之后
+inline bool peephole_fold_constants(std::vector<ZataPeepholeInstruction>& code, const ZataCodeObject& code_object,
+                                    std::vector<ZataObjectPtr>& folded) {
+    const auto labels = peephole_labels(code);
+    const size_t const_count = code_object.consts.size() + folded.size();
+    auto constant = [&code_object, &folded](const int index) {
+        const size_t i = static_cast<size_t>(index);
+        return i < code_object.consts.size() ? code_object.consts[i] : folded[i - code_object.consts.size()];
+    };
+    bool changed = false;
+    for (size_t i = 0; i + 2 < code.size(); ++i) {
+        auto& first = code[i];
+        auto& second = code[i + 1];
+        auto& calc = code[i + 2];
+        if (first.opcode != Opcode::LOAD_CONST || second.opcode != Opcode::LOAD_CONST ||
+            calc.opcode != Opcode::B_CALC || labels[i + 1] || labels[i + 2]) {
+            continue;
+        }
+        const int a = first.operands[0];
+        const int b = second.operands[0];
+        if (a < 0 || b < 0 || static_cast<size_t>(a) >= const_count || static_cast<size_t>(b) >= const_count) {
+            continue;
+        }
+        ZataValue value;
+        if (!value_binary(calc.operands[0], unbox_object(constant(a)), unbox_object(constant(b)), value)) {
+            continue;
+        }
+        folded.push_back(box_value(std::move(value)));
+
+        first.operands[0] = static_cast<int>(code_object.consts.size() + folded.size() - 1);
+        second.removed = true;
+        calc.removed = true;
+        changed = true;
+        i += 2;
+    }
+    return changed;
+}
+
+inline bool peephole_remove_noops(std::vector<ZataPeepholeInstruction>& code) {
+    const auto labels = peephole_labels(code);
+    bool changed = false;
+    for (size_t i = 0; i < code.size(); ++i) {
+        const int opcode = code[i].opcode;
+        if (opcode == Opcode::NOP) {
+            code[i].removed = true;
+            changed = true;
+            continue;
+        }
+        // 压入后立即丢弃: 两条都删除(POP不能是跳转目标, 否则别处进入POP时还要弹出值)
+        const bool pure_push = opcode == Opcode::LOAD_CONST || opcode == Opcode::LOAD_LOCAL ||
+                               opcode == Opcode::LOAD_GLOBAL || opcode == Opcode::DUP;
+        if (pure_push && i + 1 < code.size() && code[i + 1].opcode == Opcode::POP && !labels[i + 1]) {
+            code[i].removed = true;
+            code[i + 1].removed = true;
+            changed = true;
+            i += 1;
+        }
+    }
+    return changed;
+}
+
+inline bool peephole_thread_jumps(std::vector<ZataPeepholeInstruction>& code) {
+    bool changed = false;
+    for (size_t i = 0; i < code.size(); ++i) {
+        auto& jump = code[i];
+        if (!Opcode::is_jump(jump.opcode)) {
+            continue;
+        }
+        // 沿JMP链找到最终目标, 步数上限防止JMP环
+        size_t target = jump.target;
+        for (size_t steps = 0; target < code.size() && code[target].opcode == Opcode::JMP && steps < code.size(); ++steps) {
+            target = code[target].target;
+        }
+        const bool was_backward = jump.target <= i;
+        const bool is_backward = target <= i;
+        const bool allowed = jump.opcode == Opcode::JMP ? !(was_backward && !is_backward) : !is_backward || was_backward;
+        if (target != jump.target && allowed) {
+            jump.target = target;
+            changed = true;
+        }
+        if (jump.opcode == Opcode::JMP && jump.target == i + 1) {
+            jump.removed = true;
+            changed = true;
+        }
+    }
+    return changed;
+}
+
+inline bool peephole_remove_dead_code(std::vector<ZataPeepholeInstruction>& code) {
+    std::vector<bool> reachable(code.size(), false);
+    std::vector<size_t> worklist;
+    auto reach = [&](const size_t index) {
+        if (index < code.size() && !reachable[index]) {
+            reachable[index] = true;
+            worklist.push_back(index);
+        }
+    };
+    reach(0);
+    while (!worklist.empty()) {
+        const size_t index = worklist.back();
+        worklist.pop_back();
+        const auto& instruction = code[index];
+        if (Opcode::is_jump(instruction.opcode)) {
+            reach(instruction.target);
+        }
+        if (instruction.opcode != Opcode::JMP && instruction.opcode != Opcode::RET &&
+            instruction.opcode != Opcode::HALT) {
+            reach(index + 1);
+        }
+    }
+    bool changed = false;
+    for (size_t i = 0; i < code.size(); ++i) {
+        if (!reachable[i]) {
+            code[i].removed = true;
+            changed = true;
+        }
+    }
+    return changed;
+}
+
+// 合并成超级指令, 在其它改写都完成后做一次
+// 被合并的第二/三条指令不能是跳转目标; 跳到第一条的跳转照旧指向合并后的指令
+inline bool peephole_fuse(std::vector<ZataPeepholeInstruction>& code) {
+    const auto labels = peephole_labels(code);
+    auto opcode_at = [&code, &labels](const size_t index) {
+        // 跳转目标和末尾不参与合并
+        return index < code.size() && !labels[index] ? code[index].opcode : -1;
+    };
+    // 把从index开始的length条指令换成一条, 返回需要跳过的指令数
+    auto fuse = [&code](const size_t index, const int opcode, std::initializer_list<int> operands, const size_t length) {
+        auto& instruction = code[index];
+        instruction.opcode = opcode;
+        instruction.count = static_cast<int>(operands.size());
+        std::copy(operands.begin(), operands.end(), instruction.operands);
+        for (size_t i = 1; i < length; ++i) {
+            code[index + i].removed = true;
+        }
+        return length - 1;
+    };
+
+    bool changed = false;
+    for (size_t i = 0; i < code.size(); ++i) {
+        const auto& instruction = code[i];
+        const int next = opcode_at(i + 1);
+        if (instruction.opcode == Opcode::LOAD_LOCAL) {
+            const int local = instruction.operands[0];
+            if (next == Opcode::LOAD_CONST && opcode_at(i + 2) == Opcode::B_CALC) {
+                i += fuse(i, Opcode::B_CALC_LOCAL_CONST, {local, code[i + 1].operands[0], code[i + 2].operands[0]}, 3);
+            } else if (next == Opcode::GET_ATTR) {
+                i += fuse(i, Opcode::GET_LOCAL_ATTR, {local, code[i + 1].operands[0]}, 2);
+            } else if (next == Opcode::LOAD_LOCAL &&
+                       !(opcode_at(i + 2) == Opcode::LOAD_CONST && opcode_at(i + 3) == Opcode::B_CALC)) {
+                // 后一条能和它后面的LOAD_CONST; B_CALC合并时留给那边(三条合一更划算)
+                i += fuse(i, Opcode::LOAD_LOCAL2, {local, code[i + 1].operands[0]}, 2);
+            } else {
+                continue;
+            }
+        } else if (instruction.opcode == Opcode::B_CALC && next == Opcode::JMP_IF_FALSE) {
+            code[i].target = code[i + 1].target;
+            i += fuse(i, Opcode::B_CALC_JMP_IF_FALSE, {instruction.operands[0], 0}, 2);
+        } else {
+            continue;
+        }
+        changed = true;
+    }
+    return changed;
+}
+
+inline void optimize_code(ZataCodeObject& code_object) {
+    std::vector<ZataPeepholeInstruction> code;
+    std::vector<int> index_of;
+    size_t slots = 0;
+    try {
+        slots = walk_bytecode(code_object.co_code.data(), code_object.co_code.size(),
+            [&code](const size_t pc, const int opcode, const int* operands, const int count) {
+                ZataPeepholeInstruction instruction{opcode, {}, count, 0, pc, false};
+                std::copy_n(operands, count, instruction.operands);
+                code.push_back(instruction);
+            });
+    } catch (const std::exception&) {
+        return;
+    }
+
+    // 位置 -> 指令序号, 同时确认所有指令和跳转都能理解
+    index_of.assign(slots + 1, -1);
+    for (size_t i = 0; i < code.size(); ++i) {
+        index_of[code[i].origin] = static_cast<int>(i);
+    }
+    index_of[slots] = static_cast<int>(code.size());
+    for (auto& instruction : code) {
+        ZataStackEffect effect{};
+        if (!opcode_stack_effect(instruction.opcode, instruction.operands, effect)) {
+            return;
+        }
+        if (Opcode::is_jump(instruction.opcode)) {
+            const long long target = jump_target(instruction.origin, instruction.opcode, instruction.operands);
+            if (target < 0 || target > static_cast<long long>(slots) || index_of[target] < 0) {
+                return;
+            }
+            instruction.target = static_cast<size_t>(index_of[target]);
+        }
+    }
+
+    // 一种改写可能给另一种创造机会(例如折叠后相邻的常量又能折叠), 反复进行直到没有变化
+    std::vector<ZataObjectPtr> folded;
+    bool rewritten = false;
+    bool changed = true;
+    while (changed) {
+        changed = false;
+        if (peephole_fold_constants(code, code_object, folded)) {
+            peephole_compact(code);
+            changed = true;
+        }
+        for (auto* pass : {peephole_remove_noops, peephole_thread_jumps, peephole_remove_dead_code}) {
+            if (pass(code)) {
+                peephole_compact(code);
+                changed = true;
+            }
+        }
+        rewritten |= changed;
+    }
+    if (peephole_fuse(code)) {
+        peephole_compact(code);
+        rewritten = true;
+    }
+    if (!rewritten) {
+        return;
+    }
+
+    std::vector<int> positions(code.size() + 1);
+    int position = 0;
+    for (size_t i = 0; i < code.size(); ++i) {
+        positions[i] = position;
+        position += 1 + code[i].count;
+    }
+    positions[code.size()] = position;
+
+    std::vector<int> result;
+    result.reserve(position);
+    for (size_t i = 0; i < code.size(); ++i) {
+        const auto& instruction = code[i];
+        result.push_back(instruction.opcode);
+        result.insert(result.end(), instruction.operands, instruction.operands + instruction.count);
+        if (Opcode::is_jump(instruction.opcode)) {
+            // 偏移相对于它自己(最后一个操作数)所在的位置
+            result.back() = positions[instruction.target] - (positions[i] + instruction.count);
+        }
+    }
+
+    code_object.invalidate();
+    code_object.optimized_code = encode_bytecode(result);
+    code_object.folded_consts = std::move(folded);
+    code_object.optimized = true;
+    for (auto* obj : code_object.folded_consts) {
+        ZataHeap::instance().write_barrier(&code_object, obj);
+    }
+}
+
+#endif //OPTIMIZER_HPP
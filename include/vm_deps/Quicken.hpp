@@ -0,0 +1,71 @@
+#ifndef QUICKEN_HPP
+#define QUICKEN_HPP
+#include <cstdint>
+
+#include "models/Objects.hpp"
+#include "models/ZataValue.hpp"
+#include "vm_deps/ZvmOpcodes.hpp"
+
+// 快速化(quickening): 通用B_CALC站点连续若干次遇到同类立即数后, 原地改写为对应的特化指令
+// 特化指令只做一次类型守卫, 守卫失败就改写回B_CALC, 并推迟下一次快速化(退避)
+
+// 同一站点连续命中立即数快速路径多少次后改写
+#ifndef ZVM_QUICKEN_THRESHOLD
+#define ZVM_QUICKEN_THRESHOLD 8
+#endif
+
+// 退化回B_CALC后, 需要额外执行多少次才会再次尝试改写
+#ifndef ZVM_QUICKEN_BACKOFF
+#define ZVM_QUICKEN_BACKOFF 64
+#endif
+
+// 按pattern和两个操作数的类型选出特化指令, 没有合适的特化时返回0
+// 选出的特化必须与value_binary在同类型上的结果完全一致
+inline int quicken_binary(const int pattern, const ZataValue& a, const ZataValue& b) {
+    if (a.is_int() && b.is_int()) {
+        switch (pattern) {
+            case ZataSlot::ADD: return Opcode::B_ADD_INT;
+            case ZataSlot::SUB: return Opcode::B_SUB_INT;
+            case ZataSlot::MUL: return Opcode::B_MUL_INT;
+            case ZataSlot::EQ: return Opcode::B_EQ_INT;
+            case ZataSlot::LT: return Opcode::B_LT_INT;
+            case ZataSlot::GT: return Opcode::B_GT_INT;
+            default: return 0;
+        }
+    }
+    if (a.is_float() && b.is_float()) {
+        switch (pattern) {
+            case ZataSlot::ADD: return Opcode::B_ADD_FLOAT;
+            case ZataSlot::SUB: return Opcode::B_SUB_FLOAT;
+            case ZataSlot::EQ: return Opcode::B_EQ_FLOAT;
+            case ZataSlot::LT: return Opcode::B_LT_FLOAT;
+            case ZataSlot::GT: return Opcode::B_GT_FLOAT;
+            default: return 0;
+        }
+    }
+    if (a.is_double() && b.is_double()) {
+        switch (pattern) {
+            case ZataSlot::ADD: return Opcode::B_ADD_FLOAT64;
+            case ZataSlot::LT: return Opcode::B_LT_FLOAT64;
+            case ZataSlot::GT: return Opcode::B_GT_FLOAT64;
+            default: return 0;
+        }
+    }
+    return 0;
+}
+
+// 站点计数: 返回true表示已达到阈值, 计数器清零, 调用方应尝试改写
+inline bool quicken_tick(int16_t& counter) {
+    if (++counter < ZVM_QUICKEN_THRESHOLD) {
+        return false;
+    }
+    counter = 0;
+    return true;
+}
+
+// 特化失败退回B_CALC时调用
+inline void quicken_backoff(int16_t& counter) {
+    counter = -ZVM_QUICKEN_BACKOFF;
+}
+
+#endif //QUICKEN_HPP
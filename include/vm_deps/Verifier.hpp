@@ -0,0 +1,255 @@
+#ifndef VERIFIER_HPP
+#define VERIFIER_HPP
+#include <algorithm>
+#include <limits>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "models/Objects.hpp"
+#include "vm_deps/Bytecode.hpp"
+#include "vm_deps/ZvmOpcodes.hpp"
+
+// 字节码校验: 每个代码对象在第一次被链接/执行前检查一次, 结果缓存在代码对象上(verified)
+// 通过校验的代码在分发循环里不会越界访问常量池/局部变量/全局变量, 不会跳到指令中间, 也不会让操作数栈下溢,
+// 因此分发循环本身不再逐条检查这些(debug构建仍可用ZVM_STACK_CHECKS检查操作数栈)
+// 校验分两部分:
+//   verify_bytecode 只依赖代码对象本身: 指令合法性, 操作数范围, 跳转目标, 按控制流推算每条指令处的栈深度
+//                   (汇合处深度必须一致), 得出最大深度和用到的局部/全局槽位数
+//   verify_code     再按使用场景检查: 全局变量个数, 参数个数, 作为函数调用时RET处必须恰好留下一个返回值
+
+// 使用场景
+struct ZataVerifyContext {
+    size_t global_count = 0;   // 所在模块的全局变量个数
+    int arg_count = 0;         // 调用时传入的参数个数(模块代码为0)
+    bool returns_value = false; // 是否经CALL调用(RET时栈上必须恰好是返回值)
+};
+
+// 指令的栈效果: 执行前至少需要need个值, 执行后深度变化delta
+// 按int64计算: CALL/LOAD_SLL的参数个数直接来自操作数, 加一在int里可能溢出
+struct ZataStackEffect {
+    long long need;
+    long long delta;
+};
+
+// 虚拟机实现的指令的栈效果, 其余指令(包括快速指令)返回false
+inline bool opcode_stack_effect(const int opcode, const int* operands, ZataStackEffect& effect) {
+    switch (opcode) {
+        case Opcode::U_CALC: effect = {1, 0}; return true;
+        case Opcode::B_CALC: effect = {2, -1}; return true;
+        case Opcode::SWAP: effect = {2, 0}; return true;
+        case Opcode::LOAD_CONST: case Opcode::LOAD_LOCAL: case Opcode::LOAD_GLOBAL:
+        case Opcode::MAKE_INSTANCE:
+            effect = {0, 1}; return true;
+        case Opcode::STORE_LOCAL: case Opcode::STORE_GLOBAL: case Opcode::POP:
+        case Opcode::JMP_IF_FALSE: case Opcode::JMP_IF_TRUE:
+            effect = {1, -1}; return true;
+        case Opcode::JMP: case Opcode::NOP: case Opcode::RET: case Opcode::HALT:
+            effect = {0, 0}; return true;
+        case Opcode::GET_ATTR: effect = {1, 0}; return true;
+        case Opcode::LOAD_LOCAL2: effect = {0, 2}; return true;
+        case Opcode::B_CALC_LOCAL_CONST: case Opcode::GET_LOCAL_ATTR: effect = {0, 1}; return true;
+        case Opcode::B_CALC_JMP_IF_FALSE: effect = {2, -2}; return true;
+        case Opcode::SET_ATTR: effect = {2, -2}; return true;
+        case Opcode::DUP: effect = {1, 1}; return true;
+        // 弹出函数和参数, 压入返回值
+        case Opcode::CALL: effect = {operands[0] + 1LL, -static_cast<long long>(operands[0])}; return true;
+        // 弹出模块和参数, 压入返回值
+        case Opcode::LOAD_SLL: effect = {operands[1] + 1LL, -static_cast<long long>(operands[1])}; return true;
+        default:
+            return false;
+    }
+}
+
+// 跳转目标的位置: 偏移相对于最后一个操作数(偏移本身)所在的位置
+inline long long jump_target(const size_t pc, const int opcode, const int* operands) {
+    const int count = Opcode::operand_count(opcode);
+    return static_cast<long long>(pc) + count + operands[count - 1];
+}
+
+[[noreturn]] inline void verify_error(const std::string& message, const size_t pc) {
+    throw std::runtime_error("bytecode verification failed at " + std::to_string(pc) + ": " + message);
+}
+
+inline void verify_bytecode(ZataCodeObject& code_object) {
+    struct Instruction {
+        size_t pc;
+        int opcode;
+        int operands[Opcode::MAX_OPERANDS];
+    };
+    std::vector<Instruction> instructions;
+    const ZataCodeBuffer& stream = code_object.exec_code();
+    const size_t slots = walk_bytecode(stream.data(), stream.size(),
+        [&instructions](const size_t pc, const int opcode, const int* operands, const int count) {
+            Instruction instruction{pc, opcode, {}};
+            std::copy_n(operands, count, instruction.operands);
+            instructions.push_back(instruction);
+        });
+
+    // slot下标 -> 指令序号, 不是指令起点的位置为-1; 末尾(slots)也是合法的跳转目标, 效果同HALT
+    std::vector<int> index_of(slots + 1, -1);
+    for (size_t i = 0; i < instructions.size(); ++i) {
+        index_of[instructions[i].pc] = static_cast<int>(i);
+    }
+    index_of[slots] = static_cast<int>(instructions.size());
+
+    int local_slots = 0;
+    int global_slots = 0;
+    for (const auto& [pc, opcode, operands] : instructions) {
+        auto check_const = [&, pc = pc](const int index) {
+            if (index < 0 || static_cast<size_t>(index) >= code_object.const_count()) {
+                verify_error("const index " + std::to_string(index) + " out of range", pc);
+            }
+        };
+        auto check_local = [&, pc = pc](const int index) {
+            if (index < 0 || index == std::numeric_limits<int>::max()) {
+                verify_error("local index " + std::to_string(index) + " out of range", pc);
+            }
+            local_slots = std::max(local_slots, index + 1);
+        };
+        auto check_binary = [pc = pc](const int pattern) {
+            if (pattern < 0 || pattern >= ZataSlot::BINARY_COUNT) {
+                verify_error("unknown binary pattern " + std::to_string(pattern), pc);
+            }
+        };
+
+        ZataStackEffect effect{};
+        if (!opcode_stack_effect(opcode, operands, effect)) {
+            verify_error("unsupported opcode " + std::to_string(opcode), pc);
+        }
+        switch (opcode) {
+            case Opcode::LOAD_CONST: case Opcode::MAKE_INSTANCE:
+                check_const(operands[0]);
+                break;
+            case Opcode::LOAD_LOCAL: case Opcode::STORE_LOCAL: case Opcode::GET_LOCAL_ATTR:
+                check_local(operands[0]);
+                break;
+            case Opcode::LOAD_LOCAL2:
+                check_local(operands[0]);
+                check_local(operands[1]);
+                break;
+            case Opcode::B_CALC_LOCAL_CONST:
+                check_local(operands[0]);
+                check_const(operands[1]);
+                check_binary(operands[2]);
+                break;
+            case Opcode::LOAD_GLOBAL: case Opcode::STORE_GLOBAL:
+                if (operands[0] < 0 || operands[0] == std::numeric_limits<int>::max()) {
+                    verify_error("global index " + std::to_string(operands[0]) + " out of range", pc);
+                }
+                global_slots = std::max(global_slots, operands[0] + 1);
+                break;
+            case Opcode::B_CALC: case Opcode::B_CALC_JMP_IF_FALSE:
+                check_binary(operands[0]);
+                break;
+            case Opcode::U_CALC:
+                if (operands[0] < 0 || operands[0] >= ZataSlot::UNARY_COUNT) {
+                    verify_error("unknown unary pattern " + std::to_string(operands[0]), pc);
+                }
+                break;
+            case Opcode::CALL:
+                if (operands[0] < 0) {
+                    verify_error("negative argument count", pc);
+                }
+                break;
+            case Opcode::LOAD_SLL:
+                if (operands[0] < 0 || operands[1] < 0) {
+                    verify_error("negative export index or argument count", pc);
+                }
+                break;
+            default:
+                break;
+        }
+        if (Opcode::is_jump(opcode)) {
+            const long long target = jump_target(pc, opcode, operands);
+            if (target < 0 || target > static_cast<long long>(slots) || index_of[target] < 0) {
+                verify_error("jump target " + std::to_string(target) + " is not an instruction", pc);
+            }
+        }
+    }
+
+    // 按控制流传播栈深度(-1为尚未到达), 不可达的指令不参与
+    std::vector<int> depth_at(instructions.size(), -1);
+    std::vector<size_t> worklist;
+    int max_depth = 0;
+    int ret_depth = -1;
+    auto reach = [&](const size_t from, const size_t target, const int depth) {
+        if (target >= instructions.size()) {
+            return;  // 执行到末尾, 虚拟机停机
+        }
+        if (depth_at[target] < 0) {
+            depth_at[target] = depth;
+            worklist.push_back(target);
+        } else if (depth_at[target] != depth) {
+            verify_error("stack depth mismatch (" + std::to_string(depth_at[target]) + " vs " +
+                         std::to_string(depth) + ") at join " + std::to_string(instructions[target].pc),
+                         instructions[from].pc);
+        }
+    };
+    if (!instructions.empty()) {
+        depth_at[0] = 0;
+        worklist.push_back(0);
+    }
+    while (!worklist.empty()) {
+        const size_t index = worklist.back();
+        worklist.pop_back();
+        const auto& [pc, opcode, operands] = instructions[index];
+        const int depth = depth_at[index];
+
+        ZataStackEffect effect{};
+        opcode_stack_effect(opcode, operands, effect);
+        if (depth < effect.need) {
+            verify_error("stack underflow (depth " + std::to_string(depth) + ", needs " +
+                         std::to_string(effect.need) + ")", pc);
+        }
+        // need <= depth, 所以after总在[0, depth + 2]之内
+        const int after = static_cast<int>(depth + effect.delta);
+        max_depth = std::max(max_depth, after);
+
+        switch (opcode) {
+            case Opcode::RET:
+                // 各处RET的深度不一致时记为-2
+                ret_depth = ret_depth == -1 || ret_depth == depth ? depth : -2;
+                break;
+            case Opcode::HALT:
+                break;
+            case Opcode::JMP:
+                reach(index, index_of[jump_target(pc, opcode, operands)], after);
+                break;
+            default:
+                if (Opcode::is_jump(opcode)) {
+                    reach(index, index_of[jump_target(pc, opcode, operands)], after);
+                }
+                reach(index, index + 1, after);
+                break;
+        }
+    }
+
+    code_object.verified_stack = max_depth;
+    code_object.local_slots = local_slots;
+    code_object.global_slots = global_slots;
+    code_object.ret_depth = ret_depth;
+    code_object.verified = true;
+}
+
+// 校验code_object在context下的使用, 代码对象本身只校验一次
+inline void verify_code(ZataCodeObject& code_object, const ZataVerifyContext& context) {
+    if (!code_object.verified) {
+        verify_bytecode(code_object);
+    }
+    if (static_cast<size_t>(code_object.global_slots) > context.global_count) {
+        throw std::runtime_error("bytecode verification failed: global index " +
+                                 std::to_string(code_object.global_slots - 1) + " out of range");
+    }
+    // 局部变量窗口的大小与push_frame一致
+    const size_t window = std::max(code_object.locals.size(), static_cast<size_t>(std::max(context.arg_count, 0)));
+    if (static_cast<size_t>(code_object.local_slots) > window) {
+        throw std::runtime_error("bytecode verification failed: local index " +
+                                 std::to_string(code_object.local_slots - 1) + " out of range");
+    }
+    if (context.returns_value && code_object.ret_depth != -1 && code_object.ret_depth != 1) {
+        throw std::runtime_error("bytecode verification failed: function must return exactly one value");
+    }
+}
+
+#endif //VERIFIER_HPP
@@ -1,5 +1,7 @@
 #ifndef VM_DEPS_HPP
 #define VM_DEPS_HPP
+#include <iterator>
+#include <string_view>
 #include <vector>
 
 #include "../models/Objects.hpp"
@@ -19,10 +21,26 @@ struct Block {
     std::string name;
 };
 
-inline std::unordered_map<std::string,std::function<ZataObjectPtr(const std::vector<ZataObjectPtr>&)>> BuiltinsFunction = {
+// 内置函数表, 链接时按名字查出下标(见vm_deps/Linker.hpp), 运行时不再按名字查找
+struct BuiltinEntry {
+    std::string_view name;
+    ZataNativeFunction function;
+};
+
+inline constexpr BuiltinEntry BuiltinsTable[] = {
     {"print", zata_print},
     {"input", zata_input},
-    {"now", zata_now}
+    {"now", zata_now},
 };
 
+// 内置函数的下标, 不是内置函数返回-1
+inline int find_builtin(const std::string_view name) {
+    for (size_t i = 0; i < std::size(BuiltinsTable); ++i) {
+        if (BuiltinsTable[i].name == name) {
+            return static_cast<int>(i);
+        }
+    }
+    return -1;
+}
+
 #endif //VM_DEPS_HPP
@@ -71,8 +71,67 @@ namespace Opcode {
     constexpr int GET_LEN = 0x64;
     constexpr int IS_INSTANCE = 0x65;
 
+    // 超级指令: 只由加载时的优化(vm_deps/Optimizer.hpp)把常见的指令序列合并而来, 前端不应生成
+    constexpr int LOAD_LOCAL2 = 0x70;          // LOAD_LOCAL a; LOAD_LOCAL b                <a> <b>
+    constexpr int B_CALC_LOCAL_CONST = 0x71;   // LOAD_LOCAL a; LOAD_CONST c; B_CALC p     <a> <c> <p>
+    constexpr int B_CALC_JMP_IF_FALSE = 0x72;  // B_CALC p; JMP_IF_FALSE offset, 比较结果不入栈 <p> <offset>
+    constexpr int GET_LOCAL_ATTR = 0x73;       // LOAD_LOCAL a; GET_ATTR f                  <a> <f>
+
+    // 快速指令: 只由虚拟机在运行时把B_CALC原地改写而来, 前端不应生成
+    // 操作数布局与B_CALC相同(仍带pattern), 类型守卫失败时改写回B_CALC
+    constexpr int B_ADD_INT = 0x80;
+    constexpr int B_SUB_INT = 0x81;
+    constexpr int B_MUL_INT = 0x82;
+    constexpr int B_EQ_INT = 0x83;
+    constexpr int B_LT_INT = 0x84;
+    constexpr int B_GT_INT = 0x85;
+    constexpr int B_ADD_FLOAT = 0x86;
+    constexpr int B_SUB_FLOAT = 0x87;
+    constexpr int B_EQ_FLOAT = 0x88;
+    constexpr int B_LT_FLOAT = 0x89;
+    constexpr int B_GT_FLOAT = 0x8A;
+    constexpr int B_ADD_FLOAT64 = 0x8B;
+    constexpr int B_LT_FLOAT64 = 0x8C;
+    constexpr int B_GT_FLOAT64 = 0x8D;
+
+    constexpr bool is_quickened(const int opcode) {
+        return opcode >= B_ADD_INT && opcode <= B_GT_FLOAT64;
+    }
+
     // 特殊指令
+    constexpr int EXTENDED_ARG = 0x90;  // 只出现在co_code的紧凑编码中: 下一条指令的每个操作数多占一个字节(见vm_deps/Bytecode.hpp)
     constexpr int HALT = 0xFF;     // 终止执行
+
+    // 跳转指令: 最后一个操作数是偏移, 相对于这个操作数自己所在的位置
+    constexpr bool is_jump(const int opcode) {
+        return opcode == JMP || opcode == JMP_IF_TRUE || opcode == JMP_IF_FALSE || opcode == B_CALC_JMP_IF_FALSE;
+    }
+
+    // 操作数是否为有符号数(跳转偏移), 紧凑编码按此决定高位如何扩展(同一条指令的操作数一起扩展)
+    constexpr bool signed_operand(const int opcode) {
+        return is_jump(opcode);
+    }
+
+    // 一条指令最多携带的操作数个数
+    constexpr int MAX_OPERANDS = 3;
+
+    // 指令携带的操作数个数(不含opcode本身)
+    constexpr int operand_count(const int opcode) {
+        switch (opcode) {
+            case U_CALC: case B_CALC:
+            case LOAD_CONST: case LOAD_LOCAL: case STORE_LOCAL:
+            case LOAD_GLOBAL: case STORE_GLOBAL: case LOAD_CLOSURE:
+            case JMP: case JMP_IF_TRUE: case JMP_IF_FALSE: case CALL:
+            case MAKE_INSTANCE: case GET_ATTR: case SET_ATTR:
+                return 1;
+            case LOAD_SLL: case LOAD_LOCAL2: case B_CALC_JMP_IF_FALSE: case GET_LOCAL_ATTR:
+                return 2;
+            case B_CALC_LOCAL_CONST:
+                return 3;
+            default:
+                return is_quickened(opcode) ? 1 : 0;
+        }
+    }
 }
 
 #endif // OPCODE_H
\ No newline at end of file
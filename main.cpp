@@ -1,16 +1,48 @@
 #include <fstream>
+#include <optional>
 
 #include "include/ZataVM.hpp"
 #include <pybind11/pybind11.h>
 
 #include "include/models/Errors.hpp"
 #include "include/utils/Utils.hpp"
+#include "include/utils/ZirFormat.hpp"
 #include <pybind11/stl.h>  // 必须包含！
 
 #include "builtins/builtins_type.hpp"
 
 namespace py = pybind11;
 
+// Python侧持有的对象经由ZataHandle固定, 不会被回收; 包装对象销毁时解除固定(不会delete对象)
+PYBIND11_DECLARE_HOLDER_TYPE(T, ZataHandle<T>, true);
+
+// 指向对象的指针成员用def_property + 下面两个函数绑定(def_readwrite会尝试拷贝成员所指的对象)
+template <typename C, typename D>
+auto object_getter(D* C::* member) {
+	return [member](const C& self) { return self.*member; };
+}
+
+template <typename C, typename D>
+auto object_setter(D* C::* member) {
+	return [member](C& self, D* value) { self.*member = value; };
+}
+
+// 小整数, 状态值, 空字符串/元组是所有代码共享的不朽对象(回收器也不扫描它们), Python侧只能读
+template <typename C, typename D>
+auto value_getter(D C::* member) {
+	return [member](const C& self) { return self.*member; };
+}
+
+template <typename C, typename D>
+auto value_setter(D C::* member) {
+	return [member](C& self, const D& value) {
+		if (self.gc_flags & ZataGcFlag::IMMORTAL) {
+			throw py::attribute_error("can not modify a shared immortal object");
+		}
+		self.*member = value;
+	};
+}
+
 
 PYBIND11_MODULE(cppZvm, m) {
     m.doc() = "Zata虚拟机Python绑定";
@@ -21,18 +53,28 @@ PYBIND11_MODULE(cppZvm, m) {
             .def_readonly("file_mtime", &Context::file_mtime);
 
     // 执行字节码函数
+    // arena=True时本次执行新建的对象来自竞技场, 结束时除结果(及其可达的对象)外一次释放
     m.def("execute_zmod",
-        [](const std::shared_ptr<ZataModule>& module,
-            const std::vector<Context>& contexts
+        [](ZataModule* module,
+            const std::vector<Context>& contexts,
+            const bool arena
         )
-        -> std::vector<ZataObjectPtr> {
+        -> std::vector<ZataHandle<ZataObject>> {
             try {
                 Utils::enable_ansi_escape();
                 init_type_system();
 
+                // 结果在离开竞技场之前固定住; 虚拟机先于竞技场析构, 不再作为根
+                std::vector<ZataHandle<ZataObject>> results;
+                std::optional<ZataArenaScope> arena_scope;
+                if (arena) {
+                    arena_scope.emplace();
+                }
                 ZataVirtualMachine vm(module, contexts);
-                auto result_stack = vm.run();
-                return Utils::stack_to_vector(result_stack);
+                for (auto* obj : Utils::values_to_objects(vm.run())) {
+                    results.emplace_back(obj);
+                }
+                return results;
             } catch (const std::exception& e) {
                 throw py::value_error("Error from Zata Vm (GCC raised): " + std::string(e.what()));
             } catch (...) {
@@ -40,141 +82,253 @@ PYBIND11_MODULE(cppZvm, m) {
             }
         },
         "执行Zata模块并返回结果列表",
-        py::arg("module"), py::arg("contexts")
+        py::arg("module"), py::arg("contexts"), py::arg("arena") = false
     );
 
+	// 预先加载SLL模块的全部导出函数, 加载失败时在这里就报错而不是等到执行LOAD_SLL
+	m.def("preload_sll",
+		[](ZataModule* module) {
+			try {
+				preload_sll(*module);
+			} catch (const std::exception& e) {
+				throw py::value_error("Error from Zata Vm (GCC raised): " + std::string(e.what()));
+			}
+		},
+		"预加载SLL模块的导出函数",
+		py::arg("module")
+	);
+
+	// .zir二进制模块的读写(格式见utils/ZirFormat.hpp), 写出的文件可以直接交给zvm执行
+	m.def("save_zir",
+		[](ZataModule* module, const std::string& path) {
+			try {
+				const auto buffer = Zir::dump(module);
+				std::ofstream file(path, std::ios::binary);
+				file.write(reinterpret_cast<const char*>(buffer.data()), static_cast<std::streamsize>(buffer.size()));
+				if (!file) {
+					throw std::runtime_error("failed to write file: " + path);
+				}
+			} catch (const std::exception& e) {
+				throw py::value_error("Error from Zata Vm (GCC raised): " + std::string(e.what()));
+			}
+		},
+		"把模块写成.zir文件",
+		py::arg("module"), py::arg("path")
+	);
+
+	m.def("load_zir",
+		[](const std::string& path) {
+			try {
+				init_type_system();
+				return Zir::load_file(path);
+			} catch (const std::exception& e) {
+				throw py::value_error("Error from Zata Vm (GCC raised): " + std::string(e.what()));
+			}
+		},
+		"读取.zir文件得到模块",
+		py::arg("path")
+	);
+
+	// 对象池各级别的统计(只列出分配过对象的级别)
+	m.def("pool_stats",
+		[]() {
+			py::list result;
+			for (const auto& stats : ZataHeap::instance().pool_stats()) {
+				py::dict item;
+				item["object_size"] = stats.object_size;
+				item["chunks"] = stats.chunks;
+				item["live_objects"] = stats.live_objects;
+				item["allocations"] = stats.allocations;
+				item["reused"] = stats.reused;
+				result.append(item);
+			}
+			return result;
+		},
+		"对象池各级别的统计"
+	);
+
+	// 回收器接口: 没有虚拟机在执行时调用, 根只有Python侧持有的对象
+	// generation=0只做次要回收, 其余做完整回收; 返回释放的对象数
+	m.def("gc_collect",
+		[](const int generation) {
+			auto& heap = ZataHeap::instance();
+			return generation == 0 ? heap.collect_young() : heap.collect();
+		},
+		"手动触发一次回收, 返回释放的对象数",
+		py::arg("generation") = 2
+	);
+
+	m.def("gc_stats",
+		[]() {
+			const auto stats = ZataHeap::instance().stats();
+			py::dict result;
+			result["collections"] = stats.collections;
+			result["minor_collections"] = stats.minor_collections;
+			result["allocated_objects"] = stats.allocated_objects;
+			result["freed_objects"] = stats.freed_objects;
+			result["promoted_objects"] = stats.promoted_objects;
+			result["arena_releases"] = stats.arena_releases;
+			result["live_objects"] = stats.live_objects;
+			result["young_objects"] = stats.young_objects;
+			result["threshold"] = stats.threshold;
+			return result;
+		},
+		"回收器的统计"
+	);
+
+	// 传0的参数保持不变
+	m.def("gc_set_threshold",
+		[](const size_t nursery_bytes, const size_t objects) {
+			ZataHeap::instance().set_thresholds(nursery_bytes, objects);
+		},
+		"设置次要回收的新生代字节数和完整回收阈值的下限",
+		py::arg("nursery_bytes") = 0, py::arg("objects") = 0
+	);
+
+	m.def("gc_get_threshold",
+		[]() {
+			const auto& heap = ZataHeap::instance();
+			return py::make_tuple(heap.nursery_threshold(), heap.object_threshold());
+		},
+		"返回(新生代字节数, 完整回收阈值的下限)"
+	);
+
 	// 1. 顶层基类：ZataObject（所有对象的父类）
-	py::class_<ZataObject, std::shared_ptr<ZataObject>>(m, "ZataObject")
-		.def_readonly("object_type", &ZataObject::object_type)
-		.def_readonly("object_id", &ZataObject::object_id)
+	py::class_<ZataObject, ZataHandle<ZataObject>>(m, "ZataObject")
+		.def_property_readonly("object_type", [](const ZataObject& self) { return zata_type_of(&self); })
+		.def_property_readonly("object_id", &ZataObject::object_id)
 		.def("__eq__", &ZataObject::operator==);
 
 	// 2. ZataMetaType（继承 ZataObject）→ 元类型基类
-	py::class_<ZataMetaType, ZataObject, std::shared_ptr<ZataMetaType>>(m, "ZataMetaType")
-		.def(py::init<>())
-		.def_readwrite("object_type", &ZataMetaType::object_type, py::return_value_policy::reference)
-		.def_readwrite("type_new", &ZataMetaType::type_new)
-		.def_readwrite("type_init", &ZataMetaType::type_init)
-		.def_readwrite("type_add", &ZataMetaType::type_add)
-		.def_readwrite("type_sub", &ZataMetaType::type_sub)
-		.def_readwrite("type_mul", &ZataMetaType::type_mul)
-		.def_readwrite("type_div", &ZataMetaType::type_div)
-		.def_readwrite("type_mod", &ZataMetaType::type_mod)
-		.def_readwrite("type_neg", &ZataMetaType::type_neg)
-		.def_readwrite("type_eq", &ZataMetaType::type_eq)
-		.def_readwrite("type_weq", &ZataMetaType::type_weq)
-		.def_readwrite("type_gt", &ZataMetaType::type_gt)
-		.def_readwrite("type_lt", &ZataMetaType::type_lt)
-		.def_readwrite("type_ge", &ZataMetaType::type_ge)
-		.def_readwrite("type_le", &ZataMetaType::type_le)
-		.def_readwrite("type_bit_and", &ZataMetaType::type_bit_and)
-		.def_readwrite("type_bit_not", &ZataMetaType::type_bit_not)
-		.def_readwrite("type_bit_or", &ZataMetaType::type_bit_or)
-		.def_readwrite("type_bit_xor", &ZataMetaType::type_bit_xor)
-		.def_readwrite("type_nil", &ZataMetaType::type_nil)
-		.def_readwrite("type_str", &ZataMetaType::type_str)
-		.def_readwrite("type_getitem", &ZataMetaType::type_getitem)
-		.def_readwrite("type_setitem", &ZataMetaType::type_setitem)
-		.def_readwrite("type_delitem", &ZataMetaType::type_delitem)
-		.def_readwrite("type_call", &ZataMetaType::type_call)
-		.def_readwrite("type_del", &ZataMetaType::type_del);
+	py::class_<ZataMetaType, ZataObject, ZataHandle<ZataMetaType>>(m, "ZataMetaType")
+		.def(py::init<>());
 
 	// 3. ZataBuiltinsType（继承 ZataMetaType）→ 内置元类型
-	py::class_<ZataBuiltinsType, ZataMetaType, std::shared_ptr<ZataBuiltinsType>>(m, "ZataBuiltinsType")
+	py::class_<ZataBuiltinsType, ZataMetaType, ZataHandle<ZataBuiltinsType>>(m, "ZataBuiltinsType")
 		.def(py::init<>())
-		.def_readwrite("object_type", &ZataBuiltinsType::object_type, py::return_value_policy::reference)
-		.def_readwrite("type_new", &ZataBuiltinsType::type_new)
-		.def_readwrite("type_init", &ZataBuiltinsType::type_init)
-		.def_readwrite("type_add", &ZataBuiltinsType::type_add)
-		.def_readwrite("type_sub", &ZataBuiltinsType::type_sub)
-		.def_readwrite("type_mul", &ZataBuiltinsType::type_mul)
-		.def_readwrite("type_div", &ZataBuiltinsType::type_div)
-		.def_readwrite("type_mod", &ZataBuiltinsType::type_mod)
-		.def_readwrite("type_neg", &ZataBuiltinsType::type_neg)
-		.def_readwrite("type_eq", &ZataBuiltinsType::type_eq)
-		.def_readwrite("type_weq", &ZataBuiltinsType::type_weq)
-		.def_readwrite("type_gt", &ZataBuiltinsType::type_gt)
-		.def_readwrite("type_lt", &ZataBuiltinsType::type_lt)
-		.def_readwrite("type_ge", &ZataBuiltinsType::type_ge)
-		.def_readwrite("type_le", &ZataBuiltinsType::type_le)
-		.def_readwrite("type_bit_and", &ZataBuiltinsType::type_bit_and)
-		.def_readwrite("type_bit_not", &ZataBuiltinsType::type_bit_not)
-		.def_readwrite("type_bit_or", &ZataBuiltinsType::type_bit_or)
-		.def_readwrite("type_bit_xor", &ZataBuiltinsType::type_bit_xor)
-		.def_readwrite("type_nil", &ZataBuiltinsType::type_nil)
-		.def_readwrite("type_str", &ZataBuiltinsType::type_str)
-		.def_readwrite("type_getitem", &ZataBuiltinsType::type_getitem)
-		.def_readwrite("type_setitem", &ZataBuiltinsType::type_setitem)
-		.def_readwrite("type_delitem", &ZataBuiltinsType::type_delitem)
-		.def_readwrite("type_call", &ZataBuiltinsType::type_call)
-		.def_readwrite("type_del", &ZataBuiltinsType::type_del);
+		.def_property("object_type", object_getter(&ZataBuiltinsType::object_type), object_setter(&ZataBuiltinsType::object_type))
+		// 槽位是C++函数指针, Python侧只能查询是否已绑定
+		.def("has_binary_slot", [](const ZataBuiltinsType& self, const int pattern) {
+			return pattern >= 0 && pattern < ZataSlot::BINARY_COUNT && self.binary_slots[pattern] != nullptr;
+		}, py::arg("pattern"))
+		.def("has_unary_slot", [](const ZataBuiltinsType& self, const int pattern) {
+			return pattern >= 0 && pattern < ZataSlot::UNARY_COUNT && self.unary_slots[pattern] != nullptr;
+		}, py::arg("pattern"))
+		.def_property_readonly("has_str", [](const ZataBuiltinsType& self) { return self.type_str != nullptr; });
 
 	// 4. ZataUserType（继承 ZataMetaType）→ 用户自定义元类型
-	py::class_<ZataUserType, ZataMetaType, std::shared_ptr<ZataUserType>>(m, "ZataUserType")
+	py::class_<ZataUserType, ZataMetaType, ZataHandle<ZataUserType>>(m, "ZataUserType")
 		.def(py::init<>())
-		.def_readwrite("object_type", &ZataUserType::object_type, py::return_value_policy::reference)
-		.def_readwrite("type_new", &ZataUserType::type_new)
-		.def_readwrite("type_init", &ZataUserType::type_init)
-		.def_readwrite("type_add", &ZataUserType::type_add)
-		.def_readwrite("type_sub", &ZataUserType::type_sub)
-		.def_readwrite("type_mul", &ZataUserType::type_mul)
-		.def_readwrite("type_div", &ZataUserType::type_div)
-		.def_readwrite("type_mod", &ZataUserType::type_mod)
-		.def_readwrite("type_neg", &ZataUserType::type_neg)
-		.def_readwrite("type_eq", &ZataUserType::type_eq)
-		.def_readwrite("type_weq", &ZataUserType::type_weq)
-		.def_readwrite("type_gt", &ZataUserType::type_gt)
-		.def_readwrite("type_lt", &ZataUserType::type_lt)
-		.def_readwrite("type_ge", &ZataUserType::type_ge)
-		.def_readwrite("type_le", &ZataUserType::type_le)
-		.def_readwrite("type_bit_and", &ZataUserType::type_bit_and)
-		.def_readwrite("type_bit_not", &ZataUserType::type_bit_not)
-		.def_readwrite("type_bit_or", &ZataUserType::type_bit_or)
-		.def_readwrite("type_bit_xor", &ZataUserType::type_bit_xor)
-		.def_readwrite("type_nil", &ZataUserType::type_nil)
-		.def_readwrite("type_str", &ZataUserType::type_str)
-		.def_readwrite("type_getitem", &ZataUserType::type_getitem)
-		.def_readwrite("type_setitem", &ZataUserType::type_setitem)
-		.def_readwrite("type_delitem", &ZataUserType::type_delitem)
-		.def_readwrite("type_call", &ZataUserType::type_call)
-		.def_readwrite("type_del", &ZataUserType::type_del);
+		.def_property("object_type", object_getter(&ZataUserType::object_type), object_setter(&ZataUserType::object_type))
+		.def_property("type_new", object_getter(&ZataUserType::type_new), object_setter(&ZataUserType::type_new))
+		.def_property("type_init", object_getter(&ZataUserType::type_init), object_setter(&ZataUserType::type_init))
+		.def_property("type_add", object_getter(&ZataUserType::type_add), object_setter(&ZataUserType::type_add))
+		.def_property("type_sub", object_getter(&ZataUserType::type_sub), object_setter(&ZataUserType::type_sub))
+		.def_property("type_mul", object_getter(&ZataUserType::type_mul), object_setter(&ZataUserType::type_mul))
+		.def_property("type_div", object_getter(&ZataUserType::type_div), object_setter(&ZataUserType::type_div))
+		.def_property("type_mod", object_getter(&ZataUserType::type_mod), object_setter(&ZataUserType::type_mod))
+		.def_property("type_neg", object_getter(&ZataUserType::type_neg), object_setter(&ZataUserType::type_neg))
+		.def_property("type_eq", object_getter(&ZataUserType::type_eq), object_setter(&ZataUserType::type_eq))
+		.def_property("type_weq", object_getter(&ZataUserType::type_weq), object_setter(&ZataUserType::type_weq))
+		.def_property("type_gt", object_getter(&ZataUserType::type_gt), object_setter(&ZataUserType::type_gt))
+		.def_property("type_lt", object_getter(&ZataUserType::type_lt), object_setter(&ZataUserType::type_lt))
+		.def_property("type_ge", object_getter(&ZataUserType::type_ge), object_setter(&ZataUserType::type_ge))
+		.def_property("type_le", object_getter(&ZataUserType::type_le), object_setter(&ZataUserType::type_le))
+		.def_property("type_bit_and", object_getter(&ZataUserType::type_bit_and), object_setter(&ZataUserType::type_bit_and))
+		.def_property("type_bit_not", object_getter(&ZataUserType::type_bit_not), object_setter(&ZataUserType::type_bit_not))
+		.def_property("type_bit_or", object_getter(&ZataUserType::type_bit_or), object_setter(&ZataUserType::type_bit_or))
+		.def_property("type_bit_xor", object_getter(&ZataUserType::type_bit_xor), object_setter(&ZataUserType::type_bit_xor))
+		.def_property("type_nil", object_getter(&ZataUserType::type_nil), object_setter(&ZataUserType::type_nil))
+		.def_property("type_str", object_getter(&ZataUserType::type_str), object_setter(&ZataUserType::type_str))
+		.def_property("type_getitem", object_getter(&ZataUserType::type_getitem), object_setter(&ZataUserType::type_getitem))
+		.def_property("type_setitem", object_getter(&ZataUserType::type_setitem), object_setter(&ZataUserType::type_setitem))
+		.def_property("type_delitem", object_getter(&ZataUserType::type_delitem), object_setter(&ZataUserType::type_delitem))
+		.def_property("type_call", object_getter(&ZataUserType::type_call), object_setter(&ZataUserType::type_call))
+		.def_property("type_del", object_getter(&ZataUserType::type_del), object_setter(&ZataUserType::type_del));
 
 	// 5. ZataBuiltinsClass（继承 ZataObject）→ 内置数据类型基类
-	py::class_<ZataBuiltinsClass, ZataObject, std::shared_ptr<ZataBuiltinsClass>>(m, "ZataBuiltinsClass")
-		.def(py::init<>())
-		.def_readwrite("object_type", &ZataBuiltinsClass::object_type)
-		.def_readwrite("val", &ZataBuiltinsClass::val);
+	// 类型由kind决定, 只读
+	py::class_<ZataBuiltinsClass, ZataObject, ZataHandle<ZataBuiltinsClass>>(m, "ZataBuiltinsClass")
+		.def(py::init<>());
 
 	// 6. ZataCodeObject（继承 ZataObject）→ 字节码对象
-	py::class_<ZataCodeObject, ZataObject, std::shared_ptr<ZataCodeObject>>(m, "ZataCodeObject")
+	py::class_<ZataCodeObject, ZataObject, ZataHandle<ZataCodeObject>>(m, "ZataCodeObject")
 		.def(py::init<>())
-		.def_readwrite("locals", &ZataCodeObject::locals)
-		.def_readwrite("consts", &ZataCodeObject::consts)
-		.def_readwrite("co_code", &ZataCodeObject::co_code)
-		.def_readwrite("line_map", &ZataCodeObject::line_map);
+		.def_property("locals",
+			[](const ZataCodeObject& self) { return self.locals; },
+			[](ZataCodeObject& self, const std::vector<ZataObjectPtr>& locals) {
+				self.locals = locals;
+				self.invalidate();  // 虚拟机缓存作废
+			})
+		.def_property("consts",
+			[](const ZataCodeObject& self) { return self.consts; },
+			[](ZataCodeObject& self, const std::vector<ZataObjectPtr>& consts) {
+				self.consts = consts;
+				self.invalidate();
+			})
+		.def_property("co_code",
+			// 代码对象里存的是紧凑编码, 这里与int数组互相转换
+			[](const ZataCodeObject& self) { return decode_bytecode(self.co_code); },
+			[](ZataCodeObject& self, const std::vector<int>& co_code) {
+				self.co_code = encode_bytecode(co_code);
+				self.invalidate();
+			})
+		.def_readwrite("line_map", &ZataCodeObject::line_map)
+		.def_readwrite("max_stack", &ZataCodeObject::max_stack)
+		// 校验结果(链接/执行时填入), 只读
+		.def_readonly("verified", &ZataCodeObject::verified)
+		.def_readonly("verified_stack", &ZataCodeObject::verified_stack)
+		// 虚拟机实际执行的指令流(窥孔优化后的结果, 没有优化时与co_code相同), 只读
+		.def_property_readonly("exec_code",
+			[](const ZataCodeObject& self) { return decode_bytecode(self.exec_code()); });
 
 	// 7. ZataModule（继承 ZataObject）→ 模块对象
-	py::class_<ZataModule, ZataObject, std::shared_ptr<ZataModule>>(m, "ZataModule")
+	py::class_<ZataModule, ZataObject, ZataHandle<ZataModule>>(m, "ZataModule")
 		.def(py::init<>())
 		.def_readwrite("object_name", &ZataModule::object_name)
-		.def_readwrite("module_path", &ZataModule::module_path)
+		.def_property("module_path",
+			[](const ZataModule& self) { return self.module_path; },
+			[](ZataModule& self, const std::string& module_path) {
+				self.module_path = module_path;
+				self.sll_functions.clear();  // 已解析的导出函数作废
+			})
 		.def_readwrite("global_count", &ZataModule::global_count)
 		.def_readwrite("names", &ZataModule::names)
 		.def_readwrite("attrs", &ZataModule::attrs)
-		.def_readwrite("code", &ZataModule::code)
-		.def_readwrite("exports", &ZataModule::exports);
+		.def_property("code", object_getter(&ZataModule::code), object_setter(&ZataModule::code))
+		.def_property("exports",
+			[](const ZataModule& self) { return self.exports; },
+			[](ZataModule& self, const std::vector<std::string>& exports) {
+				self.exports = exports;
+				self.sll_functions.clear();
+			});
 
 	// 8. ZataFunction（继承 ZataObject）→ 函数对象
-	py::class_<ZataFunction, ZataObject, std::shared_ptr<ZataFunction>>(m, "ZataFunction")
+	py::class_<ZataFunction, ZataObject, ZataHandle<ZataFunction>>(m, "ZataFunction")
 		.def(py::init<>())
-		.def_readwrite("object_name", &ZataFunction::object_name)
-		.def_readwrite("arg_count", &ZataFunction::arg_count)
-		.def_readwrite("code", &ZataFunction::code)
+		.def_property("object_name",
+			[](const ZataFunction& self) { return self.object_name; },
+			[](ZataFunction& self, const std::string& object_name) {
+				self.object_name = object_name;
+				self.linked = false;  // 名字决定是否为内置函数, 需要重新链接
+			})
+		// 参数个数和代码对象决定校验结果, 改动后同样需要重新链接
+		.def_property("arg_count",
+			[](const ZataFunction& self) { return self.arg_count; },
+			[](ZataFunction& self, const int arg_count) {
+				self.arg_count = arg_count;
+				self.linked = false;
+			})
+		.def_property("code", object_getter(&ZataFunction::code),
+			[](ZataFunction& self, ZataCodeObject* code) {
+				self.code = code;
+				self.linked = false;
+			})
 		.def_readwrite("free_vars_names", &ZataFunction::free_vars_names)
 		.def_readwrite("free_vars", &ZataFunction::free_vars);
 
 	// 9. ZataClass（继承 ZataObject）→ 类对象
-	py::class_<ZataClass, ZataObject, std::shared_ptr<ZataClass>>(m, "ZataClass")
+	py::class_<ZataClass, ZataObject, ZataHandle<ZataClass>>(m, "ZataClass")
 		.def(py::init<>())
 		.def_readwrite("object_name", &ZataClass::object_name)
 		.def_readwrite("parent_class", &ZataClass::parent_class)
@@ -182,31 +336,47 @@ PYBIND11_MODULE(cppZvm, m) {
 		.def_readwrite("attrs", &ZataClass::attrs);
 
 	// 10. ZataInstance（继承 ZataObject）→ 实例对象
-	py::class_<ZataInstance, ZataObject, std::shared_ptr<ZataInstance>>(m, "ZataInstance")
+	py::class_<ZataInstance, ZataObject, ZataHandle<ZataInstance>>(m, "ZataInstance")
 		.def(py::init<>())
-		.def_readwrite("object_type", &ZataInstance::object_type)
-		.def_readwrite("ref_class", &ZataInstance::ref_class)
+		.def_property("object_type", object_getter(&ZataInstance::object_type), object_setter(&ZataInstance::object_type))
+		.def_property("ref_class", object_getter(&ZataInstance::ref_class), object_setter(&ZataInstance::ref_class))
 		.def_readwrite("names", &ZataInstance::names)
-		.def_readwrite("fields", &ZataInstance::fields);
+		// 字段按shape存放在槽位里, 这里按字段名转换成字典
+		.def_property("fields",
+			[](const ZataInstance& self) {
+				std::unordered_map<std::string, ZataObjectPtr> fields;
+				if (self.shape) {
+					for (size_t i = 0; i < self.shape->keys.size(); ++i) {
+						fields[self.shape->keys[i]] = box_value(self.slots[i]);
+					}
+				}
+				return fields;
+			},
+			[](ZataInstance& self, const std::unordered_map<std::string, ZataObjectPtr>& fields) {
+				self.clear_fields();
+				for (const auto& [name, value] : fields) {
+					self.set_field(name, unbox_object(value));
+				}
+			});
 
 	// 11. 内置数据类型（均继承 ZataBuiltinsClass）
 	// 字符串对象
-	py::class_<ZataString, ZataBuiltinsClass, std::shared_ptr<ZataString>>(m, "ZataString")
+	py::class_<ZataString, ZataBuiltinsClass, ZataHandle<ZataString>>(m, "ZataString")
 		.def(py::init<>())
-		.def_readwrite("val", &ZataString::val);
+		.def_property("val", value_getter(&ZataString::val), value_setter(&ZataString::val));
 
 	// 整数对象
-	py::class_<ZataInt, ZataBuiltinsClass, std::shared_ptr<ZataInt>>(m, "ZataInt")
+	py::class_<ZataInt, ZataBuiltinsClass, ZataHandle<ZataInt>>(m, "ZataInt")
 		.def(py::init<>())
-		.def_readwrite("val", &ZataInt::val);
+		.def_property("val", value_getter(&ZataInt::val), value_setter(&ZataInt::val));
 
 	// 长整数对象
-	py::class_<ZataInt64, ZataBuiltinsClass, std::shared_ptr<ZataInt64>>(m, "ZataInt64")
+	py::class_<ZataInt64, ZataBuiltinsClass, ZataHandle<ZataInt64>>(m, "ZataInt64")
 		.def(py::init<>())
 		.def_readwrite("val", &ZataInt64::val);
 
 	// 无限整数对象
-	py::class_<ZataInfInt, ZataBuiltinsClass, std::shared_ptr<ZataInfInt>>(m, "ZataInfInt")
+	py::class_<ZataInfInt, ZataBuiltinsClass, ZataHandle<ZataInfInt>>(m, "ZataInfInt")
 		.def(py::init<>())
 		.def_readwrite("is_negative", &ZataInfInt::is_negative)
 		.def_readwrite("digits", &ZataInfInt::digits)
@@ -214,17 +384,17 @@ PYBIND11_MODULE(cppZvm, m) {
 		.def_readonly_static("BASE_DIGITS", &ZataInfInt::BASE_DIGITS);
 
 	// 浮点数对象
-	py::class_<ZataFloat, ZataBuiltinsClass, std::shared_ptr<ZataFloat>>(m, "ZataFloat")
+	py::class_<ZataFloat, ZataBuiltinsClass, ZataHandle<ZataFloat>>(m, "ZataFloat")
 		.def(py::init<>())
 		.def_readwrite("val", &ZataFloat::val);
 
 	// 长浮点数对象
-	py::class_<ZataFloat64, ZataBuiltinsClass, std::shared_ptr<ZataFloat64>>(m, "ZataFloat64")
+	py::class_<ZataFloat64, ZataBuiltinsClass, ZataHandle<ZataFloat64>>(m, "ZataFloat64")
 		.def(py::init<>())
 		.def_readwrite("val", &ZataFloat64::val);
 
 	// 安全小数对象
-	py::class_<ZataDec, ZataBuiltinsClass, std::shared_ptr<ZataDec>>(m, "ZataDec")
+	py::class_<ZataDec, ZataBuiltinsClass, ZataHandle<ZataDec>>(m, "ZataDec")
 		.def(py::init<>())
 		.def_readwrite("is_negative", &ZataDec::is_negative)
 		.def_readwrite("int_digits", &ZataDec::int_digits)
@@ -233,30 +403,30 @@ PYBIND11_MODULE(cppZvm, m) {
 		.def_readonly_static("BASE_DIGITS", &ZataDec::BASE_DIGITS);
 
 	// 列表对象
-	py::class_<ZataList, ZataBuiltinsClass, std::shared_ptr<ZataList>>(m, "ZataList")
+	py::class_<ZataList, ZataBuiltinsClass, ZataHandle<ZataList>>(m, "ZataList")
 		.def(py::init<>())
 		.def_readwrite("items", &ZataList::items)
 		.def_readwrite("size", &ZataList::size);
 
 	// 字典对象
-	py::class_<ZataDict, ZataBuiltinsClass, std::shared_ptr<ZataDict>>(m, "ZataDict")
+	py::class_<ZataDict, ZataBuiltinsClass, ZataHandle<ZataDict>>(m, "ZataDict")
 		.def(py::init<>())
 		.def_readwrite("key_val", &ZataDict::key_val);
 
 	// 元组对象
-	py::class_<ZataTuple, ZataBuiltinsClass, std::shared_ptr<ZataTuple>>(m, "ZataTuple")
+	py::class_<ZataTuple, ZataBuiltinsClass, ZataHandle<ZataTuple>>(m, "ZataTuple")
 		.def(py::init<>())
-		.def_readwrite("items", &ZataTuple::items);
+		.def_property("items", value_getter(&ZataTuple::items), value_setter(&ZataTuple::items));
 
 	// 记录对象
-	py::class_<ZataRecord, ZataBuiltinsClass, std::shared_ptr<ZataRecord>>(m, "ZataRecord")
+	py::class_<ZataRecord, ZataBuiltinsClass, ZataHandle<ZataRecord>>(m, "ZataRecord")
 		.def(py::init<>())
 		.def_readwrite("attrs", &ZataRecord::attrs);
 
 	// 状态对象
-	py::class_<ZataState, ZataBuiltinsClass, std::shared_ptr<ZataState>>(m, "ZataState")
+	py::class_<ZataState, ZataBuiltinsClass, ZataHandle<ZataState>>(m, "ZataState")
 		.def(py::init<>())
-		.def_readwrite("val", &ZataState::val);
+		.def_property("val", value_getter(&ZataState::val), value_setter(&ZataState::val));
 
     // 绑定整数创建函数
     m.def("create_int", &create_int,
@@ -0,0 +1,324 @@
+// 字节码相关的回归测试(不依赖Python), 由CTest运行
+// 用法: zvm_tests [组名...], 不带参数时运行全部组; 有检查失败时以状态1退出
+#include <algorithm>
+#include <climits>
+#include <cstring>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "ZataVM.hpp"
+
+namespace {
+
+int failures = 0;
+
+#define ZVM_CHECK(cond) \
+    do { \
+        if (!(cond)) { \
+            std::cerr << __FILE__ << ":" << __LINE__ << ": check failed: " #cond << std::endl; \
+            failures += 1; \
+        } \
+    } while (0)
+
+// f()抛出异常时返回true
+template <typename F>
+bool throws(F&& f) {
+    try {
+        f();
+    } catch (const std::exception&) {
+        return true;
+    }
+    return false;
+}
+
+ZataCodeObject* make_code(const std::vector<int>& code, const std::vector<ZataObjectPtr>& consts = {},
+                          const size_t local_count = 0) {
+    auto* code_object = new ZataCodeObject();
+    code_object->co_code = encode_bytecode(code);
+    code_object->consts = consts;
+    code_object->locals.assign(local_count, create_int(0));
+    return code_object;
+}
+
+ZataFunction* make_function(const std::string& name, const int arg_count, ZataCodeObject* code) {
+    auto* function = new ZataFunction();
+    function->object_name = name;
+    function->arg_count = arg_count;
+    function->code = code;
+    return function;
+}
+
+// ---------------------------- 紧凑编码 ----------------------------
+
+void test_encoding() {
+    using namespace Opcode;
+
+    // 小操作数: 每个slot一个字节, 原样往返
+    const std::vector<int> small = {LOAD_CONST, 0, LOAD_LOCAL, 3, B_CALC, 7, JMP_IF_FALSE, 4, JMP, -7, RET, HALT};
+    const ZataCodeBuffer small_code = encode_bytecode(small);
+    ZVM_CHECK(small_code.size() == small.size());
+    ZVM_CHECK(small_code.slots() == small.size());
+    ZVM_CHECK(decode_bytecode(small_code) == small);
+
+    // 宽操作数: 每多一个字节加一个EXTENDED_ARG前缀, 小端序
+    const ZataCodeBuffer wide = encode_bytecode({LOAD_CONST, 300});
+    ZVM_CHECK((std::vector<uint8_t>(wide.data(), wide.data() + wide.size()) ==
+               std::vector<uint8_t>{EXTENDED_ARG, LOAD_CONST, 0x2C, 0x01}));
+    ZVM_CHECK(wide.slots() == 2);
+
+    // 跳转偏移按有符号数扩展, 其余操作数按无符号数扩展, 任意int都能往返
+    const ZataCodeBuffer back = encode_bytecode({JMP, -2});
+    ZVM_CHECK(back.size() == 2);
+    const std::vector<int> extremes = {
+        JMP, -129, JMP, -40000, JMP_IF_TRUE, INT32_MIN, JMP_IF_FALSE, INT32_MAX,
+        LOAD_CONST, 255, LOAD_CONST, 256, LOAD_GLOBAL, 0xFFFFFF, STORE_GLOBAL, -1,
+        LOAD_SLL, 1, 70000, B_CALC_LOCAL_CONST, 2, 1000, 0, HALT,
+    };
+    ZVM_CHECK(decode_bytecode(encode_bytecode(extremes)) == extremes);
+
+    // 执行用的单元直接由紧凑编码生成, 每个slot一个, 末尾是HALT哨兵
+    ZataCodeObject* cells = make_code(extremes);
+    const auto& stream = build_threaded_code(*cells, nullptr, nullptr, nullptr);
+    ZVM_CHECK(stream.size() == extremes.size() + 1);
+    bool same = stream.back().operand == HALT;
+    for (size_t i = 0; i < extremes.size(); ++i) {
+        same = same && stream[i].operand == extremes[i];
+    }
+    ZVM_CHECK(same);
+
+    // 不合法的输入
+    ZVM_CHECK(throws([] { encode_bytecode({300}); }));
+    ZVM_CHECK(throws([] { encode_bytecode({EXTENDED_ARG, LOAD_CONST, 0}); }));
+    ZVM_CHECK(throws([] { encode_bytecode({LOAD_CONST}); }));
+    const uint8_t prefixes[] = {EXTENDED_ARG, EXTENDED_ARG, EXTENDED_ARG, EXTENDED_ARG, LOAD_CONST, 0, 0, 0, 0, 0};
+    ZVM_CHECK(throws([&prefixes] { bytecode_slots(prefixes, sizeof(prefixes)); }));
+    const uint8_t truncated[] = {EXTENDED_ARG, LOAD_CONST, 0};
+    ZVM_CHECK(throws([&truncated] { bytecode_slots(truncated, sizeof(truncated)); }));
+}
+
+// ---------------------------- 校验器 ----------------------------
+
+// 在context下校验code, 不通过时返回true
+bool rejected(const std::vector<int>& code, const ZataVerifyContext& context = {},
+              const std::vector<ZataObjectPtr>& consts = {create_int(1)}, const size_t local_count = 0) {
+    ZataCodeObject* code_object = make_code(code, consts, local_count);
+    return throws([&] { verify_code(*code_object, context); });
+}
+
+void test_verifier() {
+    using namespace Opcode;
+
+    // 合法的代码: 按控制流得出最大栈深度
+    ZataCodeObject* loop = make_code({
+        LOAD_CONST, 0, STORE_GLOBAL, 0,
+        LOAD_GLOBAL, 0, LOAD_CONST, 0, B_CALC, 7, JMP_IF_FALSE, 9,
+        LOAD_GLOBAL, 0, LOAD_CONST, 0, B_CALC, 0, STORE_GLOBAL, 0, JMP, -17,
+        HALT,
+    }, {create_int(1)});
+    verify_code(*loop, {.global_count = 1});
+    ZVM_CHECK(loop->verified);
+    ZVM_CHECK(loop->verified_stack == 2);
+
+    // 代码本身不合法
+    ZVM_CHECK(rejected({LOAD_CONST, 1, HALT}));                              // 常量下标越界
+    ZVM_CHECK(rejected({LOAD_CONST, 0, B_CALC, 0, HALT}));                   // 操作数栈下溢
+    ZVM_CHECK(rejected({POP, HALT}));
+    ZVM_CHECK(rejected({LOAD_CONST, 0, LOAD_CONST, 0, B_CALC, 99, HALT}));   // 未知的pattern
+    ZVM_CHECK(rejected({LOAD_CONST, 0, U_CALC, 5, HALT}));
+    ZVM_CHECK(rejected({GET_ITER, HALT}));                                   // 虚拟机没有实现的指令
+    ZVM_CHECK(rejected({JMP, 0, NOP, HALT}));                                // 跳到操作数上
+    ZVM_CHECK(!rejected({JMP, 1, NOP, HALT}));
+    ZVM_CHECK(rejected({JMP, 10, HALT}));                                    // 跳出代码
+    ZVM_CHECK(rejected({                                                     // 汇合处栈深度不一致
+        LOAD_CONST, 0, LOAD_CONST, 0, JMP_IF_FALSE, 3, LOAD_CONST, 0, HALT,
+    }));
+    ZVM_CHECK(rejected({LOAD_CONST, 0, CALL, INT_MAX, HALT}));               // 参数个数超过栈深度(加一不能溢出)
+    ZVM_CHECK(rejected({LOAD_CONST, 0, CALL, INT_MIN, HALT}));
+    ZVM_CHECK(rejected({LOAD_CONST, 0, LOAD_SLL, 0, INT_MAX, HALT}));
+    ZVM_CHECK(rejected({LOAD_LOCAL, INT_MAX, HALT}));
+    ZVM_CHECK(rejected({LOAD_GLOBAL, INT_MAX, HALT}, {.global_count = 1}));
+
+    // 按使用场景检查
+    ZVM_CHECK(rejected({LOAD_GLOBAL, 3, HALT}, {.global_count = 3}));
+    ZVM_CHECK(!rejected({LOAD_GLOBAL, 3, HALT}, {.global_count = 4}));
+    ZVM_CHECK(rejected({LOAD_LOCAL, 2, RET}, {.arg_count = 2, .returns_value = true}));
+    ZVM_CHECK(!rejected({LOAD_LOCAL, 2, RET}, {.arg_count = 3, .returns_value = true}));
+    ZVM_CHECK(!rejected({LOAD_LOCAL, 2, RET}, {.returns_value = true}, {}, 3));
+    ZVM_CHECK(rejected({RET}, {.returns_value = true}));                     // 函数必须恰好返回一个值
+    ZVM_CHECK(!rejected({RET}, {}));
+
+    // 函数换到全局变量个数不同的虚拟机, 或者改了代码之后要重新校验
+    ZataFunction* function = make_function("uses_global", 0, make_code({LOAD_GLOBAL, 3, RET}));
+    link_function(*function, 4);
+    ZVM_CHECK(function_linked(*function, 4));
+    ZVM_CHECK(!function_linked(*function, 1));
+    ZVM_CHECK(throws([function] { link_function(*function, 1); }));
+    function->code->invalidate();
+    ZVM_CHECK(!function_linked(*function, 4));
+
+    // CALL的参数个数必须与函数声明的一致
+    ZataFunction* callee = make_function("takes_three", 3, make_code({LOAD_LOCAL, 2, RET}));
+    auto* module = new ZataModule();
+    module->object_name = "main";
+    module->global_count = 0;
+    module->code = make_code({LOAD_CONST, 0, CALL, 0, HALT}, {callee});
+    bool arity_error = false;
+    try {
+        ZataVirtualMachine vm(module, {});
+        vm.run();
+    } catch (const ZataVmError&) {
+        arity_error = true;
+    }
+    ZVM_CHECK(arity_error);
+}
+
+// ---------------------------- 窥孔优化 ----------------------------
+
+// 优化code, 返回优化后的int数组
+std::vector<int> optimized(ZataCodeObject* code_object) {
+    optimize_code(*code_object);
+    return decode_bytecode(code_object->exec_code());
+}
+
+void test_optimizer() {
+    using namespace Opcode;
+
+    // 常量折叠可以级联: (2 + 3) * 4, 结果放在folded_consts, co_code/consts/line_map保持原样
+    const std::vector<int> expression = {LOAD_CONST, 0, LOAD_CONST, 1, B_CALC, 0, LOAD_CONST, 2, B_CALC, 2, HALT};
+    const std::vector<std::pair<int, int>> lines = {{1, 4}, {2, 8}, {3, 10}};
+    ZataCodeObject* folded = make_code(expression, {create_int(2), create_int(3), create_int(4)});
+    folded->line_map = lines;
+    ZVM_CHECK((optimized(folded) == std::vector<int>{LOAD_CONST, 4, HALT}));
+    ZVM_CHECK(folded->consts.size() == 3 && folded->const_count() == 5);
+    const auto* product = zata_cast<ZataInt>(folded->constant(4));
+    ZVM_CHECK(product && product->val == 20);
+    ZVM_CHECK(decode_bytecode(folded->co_code) == expression);
+    ZVM_CHECK(folded->line_map == lines);
+
+    // 作废后重新优化不会让常量越积越多
+    folded->invalidate();
+    ZVM_CHECK(decode_bytecode(folded->exec_code()) == expression);
+    ZVM_CHECK((optimized(folded) == std::vector<int>{LOAD_CONST, 4, HALT}));
+    ZVM_CHECK(folded->const_count() == 5);
+
+    // 借用外部内存(映射的.zir)的co_code不会被复制或改写
+    const auto bytes = std::make_shared<ZataCodeBuffer>(encode_bytecode(expression));
+    ZataCodeObject* mapped = make_code({}, {create_int(2), create_int(3), create_int(4)});
+    mapped->co_code.borrow(bytes->data(), bytes->size(), bytes->slots(), bytes);
+    ZVM_CHECK((optimized(mapped) == std::vector<int>{LOAD_CONST, 4, HALT}));
+    ZVM_CHECK(mapped->co_code.borrowed() && mapped->co_code.data() == bytes->data());
+
+    // 除零不折叠, 留到运行时报错
+    const std::vector<int> division = {LOAD_CONST, 0, LOAD_CONST, 1, B_CALC, 3, RET};
+    ZVM_CHECK(optimized(make_code(division, {create_int(1), create_int(0)})) == division);
+
+    // NOP和紧跟POP的加载被删除, 跳到下一条的JMP被删除
+    ZVM_CHECK((optimized(make_code({NOP, LOAD_LOCAL, 0, POP, LOAD_CONST, 0, JMP, 1, HALT}, {create_int(1)}, 1)) ==
+               std::vector<int>{LOAD_CONST, 0, HALT}));
+
+    // 跳转穿透: 条件跳转直接跳到JMP的目标, 之后不可达的JMP和死代码被删除
+    ZVM_CHECK((optimized(make_code({
+        LOAD_GLOBAL, 0, JMP_IF_FALSE, 4, LOAD_CONST, 0, HALT,
+        JMP, 2, HALT,
+        LOAD_CONST, 1, HALT,
+    }, {create_int(1), create_int(2)})) == std::vector<int>{
+        LOAD_GLOBAL, 0, JMP_IF_FALSE, 4, LOAD_CONST, 0, HALT,
+        LOAD_CONST, 1, HALT,
+    }));
+
+    // 向后的JMP是安全点: 穿透到循环头之后仍然向后跳
+    const std::vector<int> loop = optimized(make_code({
+        LOAD_GLOBAL, 0, JMP_IF_FALSE, 7, LOAD_CONST, 0, STORE_GLOBAL, 0, JMP, 2,
+        HALT,
+        JMP, -12,
+    }, {create_int(0)}));
+    ZVM_CHECK((loop == std::vector<int>{LOAD_GLOBAL, 0, JMP_IF_FALSE, 7, LOAD_CONST, 0, STORE_GLOBAL, 0, JMP, -9, HALT}));
+
+    // 优化后的代码照样通过校验
+    ZataCodeObject* checked = make_code({NOP, LOAD_CONST, 0, LOAD_CONST, 0, B_CALC, 0, JMP, 1, RET}, {create_int(1)});
+    optimize_code(*checked);
+    ZVM_CHECK(!throws([checked] { verify_code(*checked, {.returns_value = true}); }));
+}
+
+// ---------------------------- 超级指令 ----------------------------
+
+void test_fusion() {
+    using namespace Opcode;
+
+    ZVM_CHECK((optimized(make_code({LOAD_LOCAL, 0, LOAD_LOCAL, 1, B_CALC, 0, RET}, {}, 2)) ==
+               std::vector<int>{LOAD_LOCAL2, 0, 1, B_CALC, 0, RET}));
+    ZVM_CHECK((optimized(make_code({LOAD_LOCAL, 0, LOAD_CONST, 0, B_CALC, 0, RET}, {create_int(1)}, 1)) ==
+               std::vector<int>{B_CALC_LOCAL_CONST, 0, 0, 0, RET}));
+    ZVM_CHECK((optimized(make_code({LOAD_LOCAL, 0, GET_ATTR, 0, LOAD_LOCAL, 0, GET_ATTR, 1, B_CALC, 0, RET}, {}, 1)) ==
+               std::vector<int>{GET_LOCAL_ATTR, 0, 0, GET_LOCAL_ATTR, 0, 1, B_CALC, 0, RET}));
+
+    // LOAD_LOCAL后面能三条合一时不先和它合成LOAD_LOCAL2
+    ZVM_CHECK((optimized(make_code({LOAD_LOCAL, 0, LOAD_LOCAL, 1, LOAD_CONST, 0, B_CALC, 0, B_CALC, 0, RET},
+                                   {create_int(1)}, 2)) ==
+               std::vector<int>{LOAD_LOCAL, 0, B_CALC_LOCAL_CONST, 1, 0, 0, B_CALC, 0, RET}));
+
+    // 比较和条件跳转合并, 偏移按合并后的位置重写
+    ZVM_CHECK((optimized(make_code({LOAD_GLOBAL, 0, LOAD_CONST, 0, B_CALC, 7, JMP_IF_FALSE, 3, JMP, -9, HALT},
+                                   {create_int(1)})) ==
+               std::vector<int>{LOAD_GLOBAL, 0, LOAD_CONST, 0, B_CALC_JMP_IF_FALSE, 7, 3, JMP, -8, HALT}));
+
+    // 跳转目标不会被合并进前一条指令
+    const std::vector<int> labelled = {
+        LOAD_CONST, 0, LOAD_GLOBAL, 0, JMP_IF_TRUE, 4, POP, LOAD_LOCAL, 0, LOAD_LOCAL, 1, B_CALC, 0, RET,
+    };
+    ZVM_CHECK(!rejected(labelled, {.global_count = 1, .returns_value = true}, {create_int(1)}, 2));
+    ZVM_CHECK(optimized(make_code(labelled, {create_int(1)}, 2)) == labelled);
+
+    // 合并后的代码执行结果不变: f(n)累加0..n-1
+    ZataFunction* sum = make_function("sum", 1, make_code({
+        LOAD_CONST, 0, STORE_LOCAL, 1, LOAD_CONST, 0, STORE_LOCAL, 2,
+        LOAD_LOCAL, 1, LOAD_LOCAL, 0, B_CALC, 7, JMP_IF_FALSE, 19,
+        LOAD_LOCAL, 2, LOAD_LOCAL, 1, B_CALC, 0, STORE_LOCAL, 2,
+        LOAD_LOCAL, 1, LOAD_CONST, 1, B_CALC, 0, STORE_LOCAL, 1, JMP, -25,
+        LOAD_LOCAL, 2, RET,
+    }, {create_int(0), create_int(1)}, 3));
+    auto* module = new ZataModule();
+    module->object_name = "main";
+    module->global_count = 0;
+    module->code = make_code({LOAD_CONST, 1, LOAD_CONST, 0, CALL, 1, HALT}, {sum, create_int(1000)});
+    ZataVirtualMachine vm(module, {});
+    const std::vector<ZataValue> results = vm.run();
+    ZVM_CHECK(results.size() == 1 && results[0].is_int() && results[0].as_int() == 499500);
+    const std::vector<int> fused = decode_bytecode(sum->code->exec_code());
+    ZVM_CHECK(std::find(fused.begin(), fused.end(), LOAD_LOCAL2) != fused.end());
+    ZVM_CHECK(std::find(fused.begin(), fused.end(), B_CALC_JMP_IF_FALSE) != fused.end());
+    ZVM_CHECK(std::find(fused.begin(), fused.end(), B_CALC_LOCAL_CONST) != fused.end());
+}
+
+struct TestGroup {
+    const char* name;
+    void (*run)();
+};
+
+const TestGroup groups[] = {
+    {"encoding", test_encoding},
+    {"verifier", test_verifier},
+    {"optimizer", test_optimizer},
+    {"fusion", test_fusion},
+};
+
+}  // namespace
+
+int main(const int argc, char** argv) {
+    init_type_system();
+    for (const auto& group : groups) {
+        bool selected = argc < 2;
+        for (int i = 1; i < argc; ++i) {
+            selected = selected || std::strcmp(argv[i], group.name) == 0;
+        }
+        if (!selected) {
+            continue;
+        }
+        const int before = failures;
+        group.run();
+        std::cout << (failures == before ? "ok   " : "FAIL ") << group.name << std::endl;
+    }
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,68 @@
+// zvm: 不经过Python直接执行.zir文件的命令行入口
+// 用法: zvm [--arena] [--print] <file.zir>
+//   --arena  本次执行使用竞技场(见ZataArenaScope)
+//   --print  执行结束后逐行打印结果(有__str__的对象)
+// 退出状态: 0为正常结束, 1为加载/校验/运行出错, 2为用法错误
+#include <cstring>
+#include <iostream>
+#include <optional>
+#include <string>
+
+#include "include/ZataVM.hpp"
+#include "include/utils/Utils.hpp"
+#include "include/utils/ZirFormat.hpp"
+
+static int usage() {
+    std::cerr << "usage: zvm [--arena] [--print] <file.zir>" << std::endl;
+    return 2;
+}
+
+int main(const int argc, char** argv) {
+    bool arena = false;
+    bool print_results = false;
+    const char* path = nullptr;
+    for (int i = 1; i < argc; ++i) {
+        if (std::strcmp(argv[i], "--arena") == 0) {
+            arena = true;
+        } else if (std::strcmp(argv[i], "--print") == 0) {
+            print_results = true;
+        } else if (argv[i][0] == '-' || path) {
+            return usage();
+        } else {
+            path = argv[i];
+        }
+    }
+    if (!path) {
+        return usage();
+    }
+
+    try {
+        Utils::enable_ansi_escape();
+        init_type_system();
+
+        // 模块在虚拟机之外也要存活(竞技场结束时虚拟机已经不再是根)
+        const ZataHandle<ZataModule> module(Zir::load_file(path));
+
+        std::optional<ZataArenaScope> arena_scope;
+        if (arena) {
+            arena_scope.emplace();
+        }
+        ZataVirtualMachine vm(module.get(), {});
+        const auto results = vm.run();
+        if (print_results) {
+            for (const auto& value : results) {
+                auto* obj = zata_cast<ZataBuiltinsClass>(box_value(value));
+                const auto* type = obj ? obj->object_type() : nullptr;
+                if (type && type->type_str) {
+                    if (const auto* str = zata_cast<ZataString>(type->type_str(obj))) {
+                        std::cout << str->val << '\n';
+                    }
+                }
+            }
+        }
+    } catch (const std::exception& e) {
+        std::cerr << "zvm: " << e.what() << std::endl;
+        return 1;
+    }
+    return 0;
+}